@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "animation.h"
+#include "rainbow_pulse.h"
+#include "launch.h"
+#include "particles.h"
+#include "formula.h"
+#include "sacn.h"
+
+static const char *names[] = {
+	[RAINBOW_PULSE] = "rainbow_pulse",
+	[LAUNCH] = "launch",
+	[PARTICLES] = "particles",
+	[FORMULA] = "formula",
+	[SACN] = "sacn",
+};
+
+int animation_parse(const char *name)
+{
+	for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+		if (strcasecmp(name, names[i]) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+int animation_takes_audio(enum animation_type type)
+{
+	return type == RAINBOW_PULSE || type == PARTICLES;
+}
+
+struct animation *animation_init(enum animation_type type, size_t num_leds, struct led *leds, const struct animation_inputs *inputs)
+{
+	struct animation *this = malloc(sizeof(*this));
+	if (!this) {
+		perror("malloc");
+		return NULL;
+	}
+	memset(this, 0, sizeof(*this));
+	this->type = type;
+	if (type == RAINBOW_PULSE) {
+		this->update = (void *) rainbow_pulse_run;
+		this->free = (void *) rainbow_pulse_free;
+		this->quality = (void *) rainbow_pulse_set_quality;
+		this->state = rainbow_pulse_init(num_leds, leds);
+		if (!this->state) {
+			perror("rainbow_pulse_init");
+			goto fail;
+		}
+		((struct rainbow_pulse *) this->state)->audio = inputs->audio;
+	} else if (type == LAUNCH) {
+		this->update = (void *) launch_run;
+		this->free = (void *) launch_free;
+		this->indexed = (void *) launch_set_indexed;
+		this->state = launch_init(num_leds, leds);
+		if (!this->state) {
+			perror("launch_init");
+			goto fail;
+		}
+		this->dirty = &((struct launch *) this->state)->dirty;
+	} else if (type == PARTICLES) {
+		this->update = (void *) particles_run;
+		this->free = (void *) particles_free;
+		this->quality = (void *) particles_set_quality;
+		this->indexed = (void *) particles_set_indexed;
+		this->state = particles_init(num_leds, leds,
+				8, /* #particles */
+				30, 50, /* velocity */
+				1, 5); /* size */
+		if (!this->state) {
+			perror("particles_init");
+			goto fail;
+		}
+		((struct particles *) this->state)->audio = inputs->audio;
+		this->dirty = &((struct particles *) this->state)->dirty;
+	} else if (type == FORMULA) {
+		this->update = (void *) formula_run;
+		this->free = (void *) formula_free;
+		this->state = formula_init(num_leds, leds, inputs->formula);
+		if (!this->state) {
+			perror("formula_init");
+			goto fail;
+		}
+	} else if (type == SACN) {
+		this->update = (void *) sacn_run;
+		this->free = (void *) sacn_free;
+		this->state = sacn_init(num_leds, leds, inputs->first_universe, SACN_PORT, ARTNET_PORT);
+		if (!this->state) {
+			perror("sacn_init");
+			goto fail;
+		}
+		this->dirty = &((struct sacn *) this->state)->dirty;
+		this->origin = &((struct sacn *) this->state)->origin;
+		((struct sacn *) this->state)->latency = inputs->latency;
+	} else {
+		fprintf(stderr, "Unknown animation\n");
+		goto fail;
+	}
+	return this;
+fail:
+	animation_free(this);
+	return NULL;
+}
+
+void animation_report(const struct animation *this)
+{
+	if (this->type == SACN) {
+		sacn_report(this->state);
+	}
+}
+
+void animation_free(struct animation *this)
+{
+	if (!this) {
+		return;
+	}
+	if (this->state) {
+		this->free(this->state);
+	}
+	free(this);
+}
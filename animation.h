@@ -0,0 +1,50 @@
+#pragma once
+#include <stddef.h>
+
+#include "led.h"
+#include "dirty.h"
+#include "audio.h"
+#include "latency.h"
+#include "palette.h"
+
+enum animation_type
+{
+	RAINBOW_PULSE = 0,
+	LAUNCH = 1,
+	PARTICLES = 2,
+	FORMULA = 3,
+	SACN = 4,
+};
+
+/* Shared inputs, each animation takes those it uses */
+struct animation_inputs
+{
+	const char *formula;
+	int first_universe;
+	struct audio *audio;
+	struct latency *latency;
+};
+
+/* An animation engine behind a common interface, rendering into leds */
+struct animation
+{
+	enum animation_type type;
+	void *state;
+	int (*update)(void *);
+	void (*free)(void *);
+	/* Maps quality level onto the animation's knobs, NULL if it has none */
+	void (*quality)(void *, int);
+	/* Switches the animation to an indexed framebuffer, NULL if unsupported */
+	int (*indexed)(void *, struct indexed *);
+	/* LEDs changed by each update, NULL if the animation redraws everything */
+	const struct dirty *dirty;
+	/* Where each update's frame came from, NULL if from the animation clock */
+	const struct frame_origin *origin;
+};
+
+/* -1 if the name is unknown */
+int animation_parse(const char *name);
+int animation_takes_audio(enum animation_type type);
+struct animation *animation_init(enum animation_type type, size_t num_leds, struct led *leds, const struct animation_inputs *inputs);
+void animation_report(const struct animation *this);
+void animation_free(struct animation *this);
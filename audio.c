@@ -0,0 +1,412 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "audio.h"
+#include "timing.h"
+#include "util.h"
+
+static const float band_min_hz = 40;
+static const float band_max_hz = 16000;
+/* Analysing more than this much backlog at once is pointless, skip it */
+static const int max_backlog_blocks = 4;
+/* Keeps a sample frame well inside raw[] and a second of samples inside size_t */
+static const unsigned max_channels = 32;
+static const unsigned long max_sample_rate = 384000;
+/* Streams that don't know their length write one of these as the data size */
+static const unsigned long unknown_size = 0xffffffff;
+
+static double monotonic_sub(const struct timespec *a, const struct timespec *b)
+{
+	return (a->tv_sec - b->tv_sec) + (a->tv_nsec - b->tv_nsec) * 1e-9;
+}
+
+static int read_full(int fd, void *buf, size_t len)
+{
+	uint8_t *it = buf;
+	while (len) {
+		ssize_t n = read(fd, it, len);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			return -1;
+		}
+		it += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static unsigned le16(const uint8_t *p)
+{
+	return p[0] | p[1] << 8;
+}
+
+static unsigned long le32(const uint8_t *p)
+{
+	return le16(p) | (unsigned long) le16(p + 2) << 16;
+}
+
+static int skip_bytes(int fd, unsigned long len)
+{
+	uint8_t buf[256];
+	while (len) {
+		size_t n = len < sizeof(buf) ? len : sizeof(buf);
+		if (read_full(fd, buf, n) != 0) {
+			return -1;
+		}
+		len -= n;
+	}
+	return 0;
+}
+
+static int parse_wav_header(struct audio *this)
+{
+	uint8_t header[16];
+	if (read_full(this->fd, header, 12) != 0 ||
+			memcmp(header, "RIFF", 4) != 0 ||
+			memcmp(header + 8, "WAVE", 4) != 0) {
+		fprintf(stderr, "audio: not a WAV stream\n");
+		return -1;
+	}
+	int have_format = 0;
+	while (1) {
+		if (read_full(this->fd, header, 8) != 0) {
+			fprintf(stderr, "audio: no data chunk\n");
+			return -1;
+		}
+		unsigned long size = le32(header + 4);
+		if (memcmp(header, "data", 4) == 0) {
+			this->data_size = size == unknown_size ? 0 : size;
+			break;
+		}
+		if (memcmp(header, "fmt ", 4) == 0 && size >= 16) {
+			if (read_full(this->fd, header, 16) != 0) {
+				return -1;
+			}
+			unsigned format = le16(header);
+			unsigned bits = le16(header + 14);
+			unsigned channels = le16(header + 2);
+			unsigned long sample_rate = le32(header + 4);
+			if ((format != 1 && format != 0xfffe) || bits != 16) {
+				fprintf(stderr, "audio: only 16-bit PCM is supported\n");
+				return -1;
+			}
+			if (channels < 1 || channels > max_channels || sample_rate < 1 || sample_rate > max_sample_rate) {
+				fprintf(stderr, "audio: unsupported format, %u channels at %lu Hz\n", channels, sample_rate);
+				return -1;
+			}
+			this->channels = channels;
+			this->sample_rate = sample_rate;
+			have_format = 1;
+			size -= 16;
+		}
+		if (skip_bytes(this->fd, size + (size & 1)) != 0) {
+			return -1;
+		}
+	}
+	if (!have_format) {
+		fprintf(stderr, "audio: no format chunk\n");
+		return -1;
+	}
+	return 0;
+}
+
+static void init_fft(struct audio *this)
+{
+	const int n = AUDIO_FFT_SIZE;
+	int bits = 0;
+	while ((1 << bits) < n) {
+		++bits;
+	}
+	for (int i = 0; i < n; ++i) {
+		int r = 0;
+		for (int b = 0; b < bits; ++b) {
+			r |= ((i >> b) & 1) << (bits - 1 - b);
+		}
+		this->bitrev[i] = r;
+		/* Hann */
+		this->window[i] = 0.5f - 0.5f * cosf(2 * M_PI * i / n);
+	}
+	for (int k = 0; k < n / 2; ++k) {
+		this->twiddle_re[k] = cosf(-2 * M_PI * k / n);
+		this->twiddle_im[k] = sinf(-2 * M_PI * k / n);
+	}
+	/* Logarithmically spaced bands, at least one bin each */
+	const float max_hz = fminf(band_max_hz, this->sample_rate / 2.0f);
+	this->band_edges[0] = clamp(1, n / 2 - AUDIO_BANDS, band_min_hz * n / this->sample_rate);
+	for (int b = 1; b <= AUDIO_BANDS; ++b) {
+		float hz = band_min_hz * powf(max_hz / band_min_hz, b * 1.0f / AUDIO_BANDS);
+		int edge = hz * n / this->sample_rate;
+		this->band_edges[b] = clamp(this->band_edges[b - 1] + 1, n / 2, edge);
+	}
+}
+
+struct audio *audio_init(const char *path)
+{
+	struct audio *this = malloc(sizeof(*this));
+	if (!this) {
+		perror("malloc");
+		goto fail;
+	}
+	memset(this, 0, sizeof(*this));
+	this->fd = strcmp(path, "-") == 0 ? dup(STDIN_FILENO) : open(path, O_RDONLY);
+	if (this->fd < 0) {
+		perror("open(audio)");
+		goto fail;
+	}
+	struct stat st;
+	if (fstat(this->fd, &st) != 0) {
+		perror("fstat");
+		goto fail;
+	}
+	this->is_stream = !S_ISREG(st.st_mode);
+	if (parse_wav_header(this) != 0) {
+		errno = EINVAL;
+		goto fail;
+	}
+	if (this->is_stream) {
+		if (fcntl(this->fd, F_SETFL, fcntl(this->fd, F_GETFL) | O_NONBLOCK) != 0) {
+			perror("fcntl");
+			goto fail;
+		}
+	} else {
+		/* Loop over whole sample frames of the data chunk, or what a truncated file has of it */
+		this->data_offset = lseek(this->fd, 0, SEEK_CUR);
+		const uint64_t available = st.st_size > this->data_offset ? st.st_size - this->data_offset : 0;
+		if (!this->data_size || this->data_size > available) {
+			this->data_size = available;
+		}
+		this->data_size -= this->data_size % (2 * this->channels);
+		if (!this->data_size) {
+			fprintf(stderr, "audio: no samples in data chunk\n");
+			errno = EINVAL;
+			goto fail;
+		}
+	}
+	init_fft(this);
+	this->start_time = timing_now();
+	return this;
+fail:
+	audio_free(this);
+	return NULL;
+}
+
+static void fft(struct audio *this)
+{
+	const int n = AUDIO_FFT_SIZE;
+	float *re = this->re;
+	float *im = this->im;
+	for (int size = 2; size <= n; size *= 2) {
+		const int half = size / 2;
+		const int step = n / size;
+		for (int start = 0; start < n; start += size) {
+			for (int k = 0; k < half; ++k) {
+				const float wr = this->twiddle_re[k * step];
+				const float wi = this->twiddle_im[k * step];
+				const int j = start + k;
+				const int l = j + half;
+				const float tr = wr * re[l] - wi * im[l];
+				const float ti = wr * im[l] + wi * re[l];
+				re[l] = re[j] - tr;
+				im[l] = im[j] - ti;
+				re[j] += tr;
+				im[j] += ti;
+			}
+		}
+	}
+}
+
+static void analyse(struct audio *this)
+{
+	struct timespec start;
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	/* Oldest sample first, windowed, in bit-reversed order */
+	for (int k = 0; k < AUDIO_FFT_SIZE; ++k) {
+		const float sample = this->ring[(this->ring_pos + k) % AUDIO_FFT_SIZE];
+		this->re[this->bitrev[k]] = sample * this->window[k];
+		this->im[k] = 0;
+	}
+	fft(this);
+	float level = 0;
+	float bass = 0;
+	for (int b = 0; b < AUDIO_BANDS; ++b) {
+		float energy = 0;
+		for (int k = this->band_edges[b]; k < this->band_edges[b + 1]; ++k) {
+			energy += this->re[k] * this->re[k] + this->im[k] * this->im[k];
+		}
+		if (b < 2) {
+			bass += energy;
+		}
+		/* Compress, then normalise against a slowly decaying peak */
+		energy = log10f(1 + energy);
+		this->band_peak[b] = fmaxf(fmaxf(energy, this->band_peak[b] * 0.995f), 0.1f);
+		float value = energy / this->band_peak[b];
+		/* Fast attack, slow release */
+		this->bands[b] = fmaxf(value, this->bands[b] * 0.85f);
+		level += this->bands[b];
+	}
+	this->level = level / AUDIO_BANDS;
+	/* Bass onset */
+	if (bass > this->bass_average * 1.5f && bass > 1e-3f && this->kick < 0.3f) {
+		this->kick = 1;
+		this->kicks++;
+	} else {
+		this->kick *= 0.8f;
+	}
+	this->bass_average = this->bass_average * 0.9f + bass * 0.1f;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	this->fft_time += monotonic_sub(&end, &start);
+	this->blocks++;
+	this->unconsumed = 1;
+}
+
+/* Returns number of completed hops */
+static int consume(struct audio *this, size_t len)
+{
+	const size_t frame_bytes = 2 * this->channels;
+	const uint8_t *it = this->raw;
+	int hops = 0;
+	this->raw_len += len;
+	size_t frames = this->raw_len / frame_bytes;
+	for (size_t f = 0; f < frames; ++f) {
+		int sum = 0;
+		for (int c = 0; c < this->channels; ++c) {
+			sum += (int16_t) le16(it);
+			it += 2;
+		}
+		this->ring[this->ring_pos] = sum / (32768.0f * this->channels);
+		this->ring_pos = (this->ring_pos + 1) % AUDIO_FFT_SIZE;
+		if (++this->pending == AUDIO_HOP) {
+			this->pending = 0;
+			++hops;
+		}
+	}
+	this->samples_read += frames;
+	this->raw_len -= frames * frame_bytes;
+	memmove(this->raw, it, this->raw_len);
+	return hops;
+}
+
+int audio_update(struct audio *this)
+{
+	const size_t frame_bytes = 2 * this->channels;
+	int hops = 0;
+	/* A live stream can't be paced, but don't stall a frame on more than 1s of it */
+	size_t want = this->sample_rate * frame_bytes;
+	if (!this->is_stream) {
+		/* Pace file playback by the frame clock */
+		uint64_t due = (timing_now() - this->start_time) * this->sample_rate;
+		want = due > this->samples_read ? (due - this->samples_read) * frame_bytes : 0;
+		size_t backlog = max_backlog_blocks * AUDIO_HOP * frame_bytes;
+		if (want > backlog) {
+			size_t skip = (want - backlog) / frame_bytes;
+			this->data_pos = (this->data_pos + skip * frame_bytes) % this->data_size;
+			if (lseek(this->fd, this->data_offset + this->data_pos, SEEK_SET) < 0) {
+				perror("lseek(audio)");
+				return -1;
+			}
+			this->samples_read += skip;
+			this->dropped_blocks += skip / AUDIO_HOP;
+			want = backlog;
+		}
+	}
+	int rewound = 0;
+	while (want) {
+		size_t len = sizeof(this->raw) - this->raw_len;
+		if (len > want) {
+			len = want;
+		}
+		/* Stop at the end of the data chunk, trailing chunks aren't samples */
+		if (this->data_size && len > this->data_size - this->data_pos) {
+			len = this->data_size - this->data_pos;
+		}
+		ssize_t n = len ? read(this->fd, this->raw + this->raw_len, len) : 0;
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			break;
+		}
+		if (n < 0) {
+			perror("read(audio)");
+			return -1;
+		}
+		if (n == 0) {
+			/* Loop the file, unless it had nothing more since the last rewind */
+			if (this->is_stream || rewound) {
+				break;
+			}
+			if (lseek(this->fd, this->data_offset, SEEK_SET) < 0) {
+				perror("lseek(audio)");
+				return -1;
+			}
+			this->data_pos = 0;
+			rewound = 1;
+			continue;
+		}
+		rewound = 0;
+		this->data_pos += n;
+		hops += consume(this, n);
+		want -= n;
+	}
+	if (hops) {
+		/* Only the newest window matters, older blocks are dropped to bound latency */
+		clock_gettime(CLOCK_MONOTONIC, &this->block_arrival);
+		this->dropped_blocks += hops - 1;
+		analyse(this);
+	}
+	return 0;
+}
+
+void audio_frame_done(struct audio *this)
+{
+	if (!this->unconsumed) {
+		return;
+	}
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	double latency = monotonic_sub(&now, &this->block_arrival);
+	this->latency_sum += latency;
+	this->latency_max = fmax(this->latency_max, latency);
+	this->latency_count++;
+	this->unconsumed = 0;
+}
+
+void audio_report(const struct audio *this)
+{
+	fprintf(stderr, "Audio: %d Hz, %d channels, %llu blocks analysed, %llu dropped, %u kicks\n",
+			this->sample_rate, this->channels,
+			(unsigned long long) this->blocks,
+			(unsigned long long) this->dropped_blocks,
+			this->kicks);
+	if (!this->blocks) {
+		return;
+	}
+	fprintf(stderr, "Audio: FFT %d points, %.1f us per block\n",
+			AUDIO_FFT_SIZE, this->fft_time / this->blocks * 1e6);
+	if (this->latency_count) {
+		fprintf(stderr, "Audio: block to frame latency mean %.2f ms, max %.2f ms, plus %.1f ms window delay\n",
+				this->latency_sum / this->latency_count * 1e3,
+				this->latency_max * 1e3,
+				AUDIO_FFT_SIZE * 0.5e3 / this->sample_rate);
+	}
+}
+
+void audio_free(struct audio *this)
+{
+	if (!this) {
+		return;
+	}
+	if (this->fd >= 0) {
+		close(this->fd);
+	}
+	free(this);
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#define AUDIO_FFT_SIZE 1024
+#define AUDIO_HOP 512
+#define AUDIO_BANDS 8
+
+struct audio
+{
+	int fd;
+	/* Pipe/device: analyse whatever has arrived.  File: pace by frame clock */
+	int is_stream;
+	int channels;
+	int sample_rate;
+	off_t data_offset;
+	/* Bytes of samples in the data chunk, 0 if a stream doesn't say, and bytes read of them */
+	uint64_t data_size;
+	uint64_t data_pos;
+	double start_time;
+	uint64_t samples_read;
+	/* Partial sample frame carried between reads */
+	uint8_t raw[8192];
+	size_t raw_len;
+	/* Most recent mono samples */
+	float ring[AUDIO_FFT_SIZE];
+	size_t ring_pos;
+	size_t pending;
+	struct timespec block_arrival;
+	/* Preallocated FFT state */
+	float window[AUDIO_FFT_SIZE];
+	float re[AUDIO_FFT_SIZE];
+	float im[AUDIO_FFT_SIZE];
+	float twiddle_re[AUDIO_FFT_SIZE / 2];
+	float twiddle_im[AUDIO_FFT_SIZE / 2];
+	uint16_t bitrev[AUDIO_FFT_SIZE];
+	int band_edges[AUDIO_BANDS + 1];
+	float band_peak[AUDIO_BANDS];
+	float bass_average;
+	/* Published to animations, 0..1 */
+	float bands[AUDIO_BANDS];
+	float level;
+	float kick;
+	/* Incremented on each detected kick */
+	unsigned kicks;
+	/* Statistics */
+	int unconsumed;
+	uint64_t blocks;
+	uint64_t dropped_blocks;
+	double fft_time;
+	uint64_t latency_count;
+	double latency_sum;
+	double latency_max;
+};
+
+struct audio *audio_init(const char *path);
+int audio_update(struct audio *this);
+void audio_frame_done(struct audio *this);
+void audio_report(const struct audio *this);
+void audio_free(struct audio *this);
@@ -0,0 +1,57 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench.h"
+
+static const struct
+{
+	const char *name;
+	int (*run)(void);
+} benches[] = {
+	{ "expr", bench_expr },
+	{ "particles", bench_particles },
+	{ "ws2812", bench_ws2812 },
+	{ "sacn", bench_sacn },
+	{ "wavetable", bench_wavetable },
+	{ "palette", bench_palette },
+	{ "calibration", bench_calibration },
+	{ "power", bench_power },
+	{ "zones", bench_zones },
+};
+
+double bench_now(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+void bench_report(const char *name, size_t num_leds, int frames, double elapsed)
+{
+	printf("  %-24s %7zu leds  %9.1f us/frame  %7.2f ns/led\n",
+			name, num_leds,
+			elapsed / frames * 1e6,
+			elapsed / frames / num_leds * 1e9);
+}
+
+int main(int argc, char *argv[])
+{
+	int ret = 0;
+	const size_t num_benches = sizeof(benches) / sizeof(benches[0]);
+	for (size_t i = 0; i < num_benches; ++i) {
+		int selected = argc < 2;
+		for (int j = 1; j < argc; ++j) {
+			selected |= strcmp(argv[j], benches[i].name) == 0;
+		}
+		if (!selected) {
+			continue;
+		}
+		printf("%s:\n", benches[i].name);
+		if (benches[i].run() != 0) {
+			fprintf(stderr, "%s: failed\n", benches[i].name);
+			ret = 1;
+		}
+	}
+	return ret;
+}
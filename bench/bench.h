@@ -0,0 +1,14 @@
+#pragma once
+
+double bench_now(void);
+void bench_report(const char *name, size_t num_leds, int frames, double elapsed);
+
+int bench_expr(void);
+int bench_particles(void);
+int bench_ws2812(void);
+int bench_sacn(void);
+int bench_wavetable(void);
+int bench_palette(void);
+int bench_calibration(void);
+int bench_power(void);
+int bench_zones(void);
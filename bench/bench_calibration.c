@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "sk9822.h"
+
+static struct calibration *load(const char *config)
+{
+	char path[] = "/tmp/led-bench-calibration-XXXXXX";
+	const int fd = mkstemp(path);
+	if (fd < 0) {
+		perror("mkstemp");
+		return NULL;
+	}
+	const ssize_t length = strlen(config);
+	struct calibration *calibration = NULL;
+	if (write(fd, config, length) == length) {
+		calibration = calibration_load(path);
+	}
+	close(fd);
+	unlink(path);
+	return calibration;
+}
+
+static double run(struct sk9822 *sk, int frames)
+{
+	const double start = bench_now();
+	for (int i = 0; i < frames; ++i) {
+		dirty_all(&sk->dirty, sk->num_leds);
+		sk9822_update(sk);
+	}
+	return bench_now() - start;
+}
+
+int bench_calibration(void)
+{
+	static const size_t sizes[] = { 300, 1000, 5000 };
+	static const char *identity = "gamma 1\n";
+	static const char *correction =
+		"red 0.95 0.05 0\n"
+		"green 0.02 0.9 0.03\n"
+		"blue 0 0.05 0.85\n"
+		"gamma 2.2 2.0 2.4\n";
+	/* Runs alternate between configurations, best of the rounds counts */
+	const int frames = 400;
+	const int rounds = 5;
+	char integer[128];
+	snprintf(integer, sizeof(integer), "%sinteger\n", correction);
+	/* The identity goes through the same calibrated path, so it is the baseline */
+	struct calibration *calibrations[] = { NULL, load(identity), load(correction), load(integer) };
+	static const char *names[] = { "uncalibrated", "identity", "matrix, gamma", "fixed point" };
+	const size_t count = sizeof(calibrations) / sizeof(calibrations[0]);
+	int ret = -1;
+	for (size_t c = 1; c < count; ++c) {
+		if (!calibrations[c]) {
+			goto fail;
+		}
+	}
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+		const size_t num_leds = sizes[s];
+		struct sk9822 *sk = sk9822_init("/dev/null", 1000000, num_leds);
+		uint8_t *reference = calloc(sk ? sk->message_size : 1, 1);
+		if (!sk || !reference) {
+			sk9822_free(sk);
+			free(reference);
+			goto fail;
+		}
+		for (size_t i = 0; i < num_leds; ++i) {
+			sk->leds[i] = (struct led) {
+				.brightness = (i % 5) / 4.0f,
+				.colour = { .r = (i % 7) / 6.0f, .g = (i % 11) / 10.0f, .b = (i % 13) / 12.0f }
+			};
+		}
+
+		/* Warm caches, LUTs and clocks before anything is timed */
+		for (size_t c = 0; c < count; ++c) {
+			sk->calibration = calibrations[c];
+			run(sk, frames);
+		}
+
+		double best[sizeof(calibrations) / sizeof(calibrations[0])];
+		size_t differing[sizeof(calibrations) / sizeof(calibrations[0])] = { 0 };
+		for (int r = 0; r < rounds; ++r) {
+			for (size_t c = 0; c < count; ++c) {
+				sk->calibration = calibrations[c];
+				const double elapsed = run(sk, frames);
+				if (r == 0 || elapsed < best[c]) {
+					best[c] = elapsed;
+				}
+				if (c == 0) {
+					memcpy(reference, sk->message, sk->message_size);
+				}
+				differing[c] = 0;
+				for (size_t i = 0; i < sk->message_size; ++i) {
+					differing[c] += reference[i] != sk->message[i];
+				}
+			}
+		}
+
+		for (size_t c = 0; c < count; ++c) {
+			bench_report(names[c], num_leds, frames, best[c]);
+			if (c > 1) {
+				printf("  %+.0f%% over identity, %zu bytes differ from uncalibrated\n",
+						(best[c] / best[1] - 1) * 100, differing[c]);
+			} else if (c == 1) {
+				printf("  %zu bytes differ from uncalibrated\n", differing[c]);
+			}
+		}
+		sk9822_free(sk);
+		free(reference);
+	}
+	ret = 0;
+fail:
+	for (size_t c = 1; c < count; ++c) {
+		calibration_free(calibrations[c]);
+	}
+	return ret;
+}
@@ -0,0 +1,95 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "colour.h"
+#include "timing.h"
+#include "formula.h"
+
+/* launch's waveform, without the wrap of its time_phase */
+static const char *launch_formula =
+	"a = max(sin(2 * pi * (-t / 0.8 + pow(i / n, 0.1) * n / 40)) - 0.8, 0) / 0.2;"
+	"a = pow(a, 8);"
+	"hsv(0.6, 1 - pow(a, 4), a)";
+
+/* The same in C, evaluated per LED as launch_run did before its wavetable */
+static void native_launch(struct led *leds, size_t num_leds, float t)
+{
+	for (size_t i = 0; i < num_leds; ++i) {
+		float arg = sinf(2 * M_PI * (-t / 0.8f + powf(i * 1.0f / num_leds, 0.1f) * num_leds / 40));
+		arg = arg < 0.8f ? 0 : powf((arg - 0.8f) / 0.2f, 8);
+		leds[i].brightness = 1;
+		struct hsv hsv = { .h = 0.6, .s = 1 - powf(arg, 4), .v = arg };
+		hsv2rgb(&hsv, &leds[i].colour);
+	}
+}
+
+static int run(size_t num_leds, int frames)
+{
+	struct formula *formula = NULL;
+	struct led *native_leds = calloc(num_leds, sizeof(*native_leds));
+	struct led *formula_leds = calloc(num_leds, sizeof(*formula_leds));
+	if (!native_leds || !formula_leds) {
+		perror("calloc");
+		goto fail;
+	}
+
+	timing_clock_init(TIMING_VIRTUAL, 0.01);
+	struct timing timing;
+	if (timing_init(&timing) != 0) {
+		perror("timing_init");
+		goto fail;
+	}
+	float t = 0;
+	double start = bench_now();
+	for (int i = 0; i < frames; ++i) {
+		timing_tick();
+		t += timing_step(&timing);
+		native_launch(native_leds, num_leds, t);
+	}
+	bench_report("native", num_leds, frames, bench_now() - start);
+
+	timing_clock_init(TIMING_VIRTUAL, 0.01);
+	formula = formula_init(num_leds, formula_leds, launch_formula);
+	if (!formula) {
+		goto fail;
+	}
+	start = bench_now();
+	for (int i = 0; i < frames; ++i) {
+		timing_tick();
+		formula_run(formula);
+	}
+	bench_report("formula (launch)", num_leds, frames, bench_now() - start);
+
+	/* Both hold the frame at the same time */
+	float error = 0;
+	for (size_t i = 0; i < num_leds; ++i) {
+		error = fmaxf(error, fabsf(native_leds[i].colour.r - formula_leds[i].colour.r));
+		error = fmaxf(error, fabsf(native_leds[i].colour.g - formula_leds[i].colour.g));
+		error = fmaxf(error, fabsf(native_leds[i].colour.b - formula_leds[i].colour.b));
+	}
+	printf("  max deviation from native: %g\n", error);
+
+	formula_free(formula);
+	free(native_leds);
+	free(formula_leds);
+	return 0;
+fail:
+	formula_free(formula);
+	free(native_leds);
+	free(formula_leds);
+	return -1;
+}
+
+int bench_expr(void)
+{
+	static const size_t sizes[] = { 288, 1000, 10000 };
+	const int frames = 400;
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+		if (run(sizes[s], frames) != 0) {
+			return -1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "colour.h"
+#include "palette.h"
+#include "sk9822.h"
+#include "ws2812.h"
+
+/* A rainbow gradient, as both a float framebuffer and palette indices */
+static struct palette *fill(struct led *leds, struct indexed *indexed, size_t num_leds, int palette_size)
+{
+	struct palette *palette = palette_init(palette_size);
+	if (!palette) {
+		return NULL;
+	}
+	for (int k = 0; k < palette_size; ++k) {
+		struct hsv hsv = { .h = (float) k / palette_size, .s = 1, .v = 1 };
+		struct rgb rgb;
+		hsv2rgb(&hsv, &rgb);
+		palette_set(palette, k, &rgb);
+	}
+	palette_commit(palette);
+	if (indexed_set_palette(indexed, palette) != 0) {
+		palette_free(palette);
+		return NULL;
+	}
+	for (size_t i = 0; i < num_leds; ++i) {
+		const int k = i % palette_size;
+		const int intensity = 255 - i % 64;
+		leds[i].brightness = intensity / 255.0f;
+		leds[i].colour = palette->colours[k];
+		indexed_set(indexed, i, k, intensity);
+	}
+	return palette;
+}
+
+int bench_palette(void)
+{
+	static const size_t sizes[] = { 1000, 10000 };
+	static const int palette_sizes[] = { 256, 4096 };
+	const int frames = 1000;
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+		const size_t num_leds = sizes[s];
+		for (size_t p = 0; p < sizeof(palette_sizes) / sizeof(palette_sizes[0]); ++p) {
+			struct sk9822 *sk = sk9822_init("/dev/null", 1000000, num_leds);
+			struct ws2812 *ws = ws2812_init("/dev/null", num_leds, 0);
+			struct indexed *indexed = indexed_init(num_leds);
+			if (!sk || !ws || !indexed) {
+				return -1;
+			}
+			struct palette *palette = fill(sk->leds, indexed, num_leds, palette_sizes[p]);
+			if (!palette) {
+				return -1;
+			}
+			for (size_t i = 0; i < num_leds; ++i) {
+				ws->leds[i] = sk->leds[i];
+			}
+			printf("  %d colours: framebuffer %zu bytes/LED float, %zu indexed\n",
+					palette->size, sizeof(struct led),
+					(indexed->wide ? sizeof(uint16_t) : sizeof(uint8_t)) + sizeof(uint8_t));
+
+			double start = bench_now();
+			for (int i = 0; i < frames; ++i) {
+				dirty_all(&sk->dirty, num_leds);
+				sk9822_update(sk);
+			}
+			bench_report("sk9822 float", num_leds, frames, bench_now() - start);
+			sk->indexed = indexed;
+			start = bench_now();
+			for (int i = 0; i < frames; ++i) {
+				dirty_all(&sk->dirty, num_leds);
+				sk9822_update(sk);
+			}
+			bench_report("sk9822 indexed", num_leds, frames, bench_now() - start);
+
+			start = bench_now();
+			for (int i = 0; i < frames; ++i) {
+				dirty_all(&ws->dirty, num_leds);
+				ws2812_encode(ws);
+			}
+			bench_report("ws2812 float", num_leds, frames, bench_now() - start);
+			ws->indexed = indexed;
+			start = bench_now();
+			for (int i = 0; i < frames; ++i) {
+				dirty_all(&ws->dirty, num_leds);
+				ws2812_encode(ws);
+			}
+			bench_report("ws2812 indexed", num_leds, frames, bench_now() - start);
+
+			sk9822_free(sk);
+			ws2812_free(ws);
+			indexed_free(indexed);
+			palette_free(palette);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,121 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "timing.h"
+#include "particles.h"
+
+/* The interleaved layout particles used before, as a reference */
+struct aos_particle
+{
+	float position;
+	float velocity;
+	float next_position;
+	float next_velocity;
+	float mass;
+	float size;
+	struct rgb colour;
+	int immobile;
+};
+
+static void aos_propagate(struct aos_particle *particles, int n, float dt)
+{
+	for (struct aos_particle *p = particles, *end = p + n; p != end; ++p) {
+		p->next_position = p->position + dt * p->velocity;
+		p->next_velocity = p->velocity;
+	}
+}
+
+static void aos_commit(struct aos_particle *particles, int n)
+{
+	for (struct aos_particle *p = particles, *end = p + n; p != end; ++p) {
+		if (p->immobile) {
+			continue;
+		}
+		p->position = p->next_position;
+		p->velocity = p->next_velocity;
+	}
+}
+
+static float aos_calc_energy(const struct aos_particle *particles, int n)
+{
+	float result = 0;
+	for (const struct aos_particle *p = particles, *end = p + n; p != end; ++p) {
+		result += p->mass * p->velocity * p->velocity;
+	}
+	return result / 2;
+}
+
+static void aos_conserve_energy(struct aos_particle *particles, int n, float total_energy)
+{
+	float deficit = (total_energy - aos_calc_energy(particles, n)) / n;
+	for (struct aos_particle *p = particles, *end = p + n; p != end; ++p) {
+		if (p->immobile) {
+			continue;
+		}
+		p->velocity *= sqrtf(1 + 2 * deficit / (p->mass * p->velocity * p->velocity));
+	}
+}
+
+int bench_particles(void)
+{
+	static const int sizes[] = { 1000, 10000, 100000 };
+	const int iterations = 200;
+	const float dt = 1e-4f;
+	timing_clock_init(TIMING_VIRTUAL, 0.01);
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+		const int n = sizes[s];
+		const size_t num_leds = n * 10;
+		struct led *leds = calloc(num_leds, sizeof(*leds));
+		struct particles *soa = particles_init(num_leds, leds, n, 30, 50, 1, 5);
+		struct aos_particle *aos = calloc(n + 2, sizeof(*aos));
+		if (!leds || !soa || !aos) {
+			particles_free(soa);
+			free(aos);
+			free(leds);
+			return -1;
+		}
+		for (int i = 0; i < n; ++i) {
+			aos[i + 1] = (struct aos_particle) {
+				.position = soa->position[i],
+				.velocity = soa->velocity[i],
+				.mass = soa->mass[i],
+				.size = soa->size[i],
+				.colour = soa->colour[i]
+			};
+		}
+		aos[0] = (struct aos_particle) { .mass = 1e9, .size = 1, .immobile = 1 };
+		aos[n + 1] = (struct aos_particle) { .position = num_leds - 1, .mass = 1e9, .size = 1, .immobile = 1 };
+		const float aos_energy = aos_calc_energy(aos, n + 2);
+
+		/* propagate + commit + conserve_energy, as done once per collision and frame */
+		double start = bench_now();
+		for (int it = 0; it < iterations; ++it) {
+			aos_propagate(aos, n + 2, dt);
+			aos_commit(aos, n + 2);
+			aos_conserve_energy(aos, n + 2, aos_energy);
+		}
+		double aos_time = (bench_now() - start) / iterations;
+
+		start = bench_now();
+		for (int it = 0; it < iterations; ++it) {
+			particles_propagate(soa, dt);
+			particles_conserve_energy(soa);
+		}
+		double soa_time = (bench_now() - start) / iterations;
+
+		printf("  %6d particles  interleaved %8.2f us  planar %8.2f us  (%.1fx)\n",
+				n, aos_time * 1e6, soa_time * 1e6, aos_time / soa_time);
+		float drift = 0;
+		for (int i = 0; i < n; ++i) {
+			drift = fmaxf(drift, fabsf(aos[i + 1].position - soa->position[i]));
+		}
+		printf("  %6d particles  max position difference %g\n", n, drift);
+
+		particles_free(soa);
+		free(aos);
+		free(leds);
+	}
+	return 0;
+}
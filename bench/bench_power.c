@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "sk9822.h"
+#include "ws2812.h"
+
+/* Estimated draw of a sk9822 wire buffer, recomputed from scratch */
+static double wire_draw(const struct sk9822 *sk)
+{
+	uint64_t total = 0;
+	for (size_t i = 0; i < sk->num_leds; ++i) {
+		const uint8_t *it = sk->message + 4 + 4 * i;
+		total += (it[0] & 0x1f) * (it[1] + it[2] + it[3]);
+	}
+	return total * SK9822_POWER_UNIT + sk->num_leds;
+}
+
+static double run_sk9822(struct sk9822 *sk, int frames)
+{
+	const double start = bench_now();
+	for (int i = 0; i < frames; ++i) {
+		dirty_all(&sk->dirty, sk->num_leds);
+		sk9822_update(sk);
+	}
+	return bench_now() - start;
+}
+
+static double run_ws2812(struct ws2812 *ws, int frames)
+{
+	const double start = bench_now();
+	for (int i = 0; i < frames; ++i) {
+		dirty_all(&ws->dirty, ws->num_leds);
+		ws2812_encode(ws);
+	}
+	return bench_now() - start;
+}
+
+int bench_power(void)
+{
+	const size_t num_leds = 1000;
+	const int frames = 2000;
+	/* Unlimited, within budget, then about half of what the frame draws */
+	static const double budgets[] = { 0, 100000, 20000 };
+	static const char *names[] = { "no limiter", "within budget", "limited" };
+	struct sk9822 *sk = sk9822_init("/dev/null", 1000000, num_leds);
+	struct ws2812 *ws = ws2812_init("/dev/null", num_leds, 0);
+	if (!sk || !ws) {
+		return -1;
+	}
+	for (size_t i = 0; i < num_leds; ++i) {
+		sk->leds[i] = ws->leds[i] = (struct led) {
+			.brightness = 1,
+			.colour = { .r = 1, .g = (i % 11) / 10.0f, .b = (i % 13) / 12.0f }
+		};
+	}
+	for (size_t b = 0; b < sizeof(budgets) / sizeof(budgets[0]); ++b) {
+		struct power *sk_power = budgets[b] ? power_init(num_leds, budgets[b], SK9822_POWER_UNIT) : NULL;
+		struct power *ws_power = budgets[b] ? power_init(num_leds, budgets[b], WS2812_POWER_UNIT) : NULL;
+		if (budgets[b] && (!sk_power || !ws_power)) {
+			return -1;
+		}
+		char name[64];
+		sk->power = sk_power;
+		snprintf(name, sizeof(name), "sk9822 %s", names[b]);
+		bench_report(name, num_leds, frames, run_sk9822(sk, frames));
+		printf("  wire buffer draws %.0f mA\n", wire_draw(sk));
+		ws->power = ws_power;
+		snprintf(name, sizeof(name), "ws2812 %s", names[b]);
+		bench_report(name, num_leds, frames, run_ws2812(ws, frames));
+		sk->power = NULL;
+		ws->power = NULL;
+		power_free(sk_power);
+		power_free(ws_power);
+	}
+	sk9822_free(sk);
+	ws2812_free(ws);
+	return 0;
+}
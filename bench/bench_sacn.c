@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "bench.h"
+#include "sacn.h"
+
+/* Away from the real port so a running instance doesn't interfere */
+#define BENCH_PORT 45568
+
+static void send_frames(int num_universes, int frames)
+{
+	int fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0) {
+		perror("socket");
+		_exit(1);
+	}
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_port = htons(BENCH_PORT),
+		.sin_addr = { .s_addr = htonl(INADDR_LOOPBACK) }
+	};
+	uint8_t data[SACN_LEDS_PER_UNIVERSE * 3];
+	uint8_t packet[SACN_MAX_PACKET];
+	for (int frame = 0; frame < frames; ++frame) {
+		memset(data, frame, sizeof(data));
+		for (int u = 0; u < num_universes; ++u) {
+			size_t len = sacn_build_e131(packet, 1 + u, frame, data, sizeof(data));
+			sendto(fd, packet, len, 0, (struct sockaddr *) &addr, sizeof(addr));
+		}
+		/* Let the receiver keep up rather than measure the socket buffer */
+		if (frame % 16 == 15) {
+			usleep(100);
+		}
+	}
+	close(fd);
+	_exit(0);
+}
+
+int bench_sacn(void)
+{
+	static const int universe_counts[] = { 1, 8, 64 };
+	const int total = 100000;
+	for (size_t s = 0; s < sizeof(universe_counts) / sizeof(universe_counts[0]); ++s) {
+		const int num_universes = universe_counts[s];
+		const int frames = total / num_universes;
+		const size_t num_leds = num_universes * SACN_LEDS_PER_UNIVERSE;
+		struct led *leds = calloc(num_leds, sizeof(*leds));
+		struct sacn *sacn = leds ? sacn_init(num_leds, leds, 1, BENCH_PORT, 0) : NULL;
+		if (!sacn) {
+			free(leds);
+			return -1;
+		}
+		double start = bench_now();
+		pid_t pid = fork();
+		if (pid < 0) {
+			perror("fork");
+			return -1;
+		}
+		if (pid == 0) {
+			send_frames(num_universes, frames);
+		}
+		double last = start;
+		uint64_t seen = 0;
+		int exited = 0;
+		while (!exited || bench_now() - last < 0.1) {
+			if (sacn_poll(sacn) != 0) {
+				break;
+			}
+			if (sacn->universes != seen) {
+				seen = sacn->universes;
+				last = bench_now();
+			}
+			if (sacn->ready_new) {
+				sacn_run(sacn);
+			}
+			exited = exited || waitpid(pid, NULL, WNOHANG) == pid;
+		}
+		const double elapsed = last - start;
+		printf("  %3d universes/frame  %9.0f universes/s  %7.0f frames/s  %llu lost  %llu complete  %llu presented\n",
+				num_universes,
+				sacn->universes / elapsed,
+				sacn->complete / elapsed,
+				(unsigned long long) sacn->lost,
+				(unsigned long long) sacn->complete,
+				(unsigned long long) sacn->presented);
+		sacn_free(sacn);
+		free(leds);
+	}
+	return 0;
+}
@@ -0,0 +1,79 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "colour.h"
+#include "wavetable.h"
+
+/* launch's waveform and LED spacing */
+static void shape(float u, struct led *led)
+{
+	float arg = sinf(2 * M_PI * u);
+	arg = arg < 0.8f ? 0 : powf((arg - 0.8f) / 0.2f, 8);
+	led->brightness = 1;
+	struct hsv hsv = { .h = 0.6, .s = 1 - powf(arg, 4), .v = arg };
+	hsv2rgb(&hsv, &led->colour);
+}
+
+static float offset(size_t i, size_t num_leds)
+{
+	return powf(i * 1.0f / num_leds, 0.1f) * num_leds / 40;
+}
+
+int bench_wavetable(void)
+{
+	static const size_t sizes[] = { 288, 1000, 10000 };
+	static const int table_sizes[] = { 512, 2048, 8192 };
+	const int frames = 400;
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+		const size_t num_leds = sizes[s];
+		struct led *direct = calloc(num_leds, sizeof(*direct));
+		struct led *gathered = calloc(num_leds, sizeof(*gathered));
+		float *offsets = calloc(num_leds, sizeof(*offsets));
+		if (!direct || !gathered || !offsets) {
+			perror("calloc");
+			return -1;
+		}
+		for (size_t i = 0; i < num_leds; ++i) {
+			offsets[i] = offset(i, num_leds);
+		}
+
+		double start = bench_now();
+		for (int f = 0; f < frames; ++f) {
+			const float phase = f * -0.0125f;
+			for (size_t i = 0; i < num_leds; ++i) {
+				float u = phase + offsets[i];
+				shape(u - floorf(u), &direct[i]);
+			}
+		}
+		bench_report("per-LED evaluation", num_leds, frames, bench_now() - start);
+
+		for (size_t t = 0; t < sizeof(table_sizes) / sizeof(table_sizes[0]); ++t) {
+			struct wavetable *wave = wavetable_init(num_leds, gathered, table_sizes[t], shape, offset);
+			if (!wave) {
+				return -1;
+			}
+			start = bench_now();
+			for (int f = 0; f < frames; ++f) {
+				wavetable_render(wave, f * -0.0125f, 0, num_leds);
+			}
+			char name[32];
+			snprintf(name, sizeof(name), "wavetable (%d)", table_sizes[t]);
+			bench_report(name, num_leds, frames, bench_now() - start);
+			/* Both hold the last frame */
+			float error = 0;
+			for (size_t i = 0; i < num_leds; ++i) {
+				error = fmaxf(error, fabsf(direct[i].colour.r - gathered[i].colour.r));
+				error = fmaxf(error, fabsf(direct[i].colour.g - gathered[i].colour.g));
+				error = fmaxf(error, fabsf(direct[i].colour.b - gathered[i].colour.b));
+			}
+			printf("  max deviation: %.2f/255\n", error * 255);
+			wavetable_free(wave);
+		}
+		free(direct);
+		free(gathered);
+		free(offsets);
+	}
+	return 0;
+}
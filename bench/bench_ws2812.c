@@ -0,0 +1,78 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "ws2812.h"
+
+/* Bit-at-a-time expansion, as a reference */
+static uint8_t *naive_put(uint8_t *it, int value)
+{
+	uint32_t bits = 0;
+	for (int bit = 7; bit >= 0; --bit) {
+		bits = (bits << 4) | ((value >> bit) & 1 ? 0xe : 0x8);
+	}
+	*it++ = bits >> 24;
+	*it++ = bits >> 16;
+	*it++ = bits >> 8;
+	*it++ = bits;
+	return it;
+}
+
+static int quantise(float value)
+{
+	return !(value > 0) ? 0 : value > 1 ? 255 : (int) roundf(value * 255);
+}
+
+static void naive_encode(const struct led *leds, size_t num_leds, uint8_t *message)
+{
+	for (const struct led *led = leds, *end = leds + num_leds; led != end; ++led) {
+		message = naive_put(message, quantise(led->colour.g * led->brightness));
+		message = naive_put(message, quantise(led->colour.r * led->brightness));
+		message = naive_put(message, quantise(led->colour.b * led->brightness));
+	}
+}
+
+int bench_ws2812(void)
+{
+	static const size_t sizes[] = { 300, 1000, 5000 };
+	const int frames = 2000;
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+		const size_t num_leds = sizes[s];
+		struct ws2812 *ws = ws2812_init("/dev/null", num_leds, 0);
+		uint8_t *reference = calloc(ws ? ws->message_size : 1, 1);
+		if (!ws || !reference) {
+			return -1;
+		}
+		for (size_t i = 0; i < num_leds; ++i) {
+			ws->leds[i] = (struct led) {
+				.brightness = 1,
+				.colour = { .r = (i % 7) / 6.0f, .g = (i % 11) / 10.0f, .b = (i % 13) / 12.0f }
+			};
+		}
+
+		double start = bench_now();
+		for (int i = 0; i < frames; ++i) {
+			naive_encode(ws->leds, num_leds, reference);
+		}
+		double naive = bench_now() - start;
+		bench_report("bit-by-bit", num_leds, frames, naive);
+
+		start = bench_now();
+		for (int i = 0; i < frames; ++i) {
+			dirty_all(&ws->dirty, num_leds);
+			ws2812_encode(ws);
+		}
+		double encoder = bench_now() - start;
+		bench_report("encoder", num_leds, frames, encoder);
+
+		printf("  %.1f Mleds/s, %s reference, wire time %.1f ms per frame\n",
+				num_leds * frames / encoder * 1e-6,
+				memcmp(reference, ws->message, ws->message_size) == 0 ? "matches" : "DIFFERS from",
+				ws->message_size * 8e3 / WS2812_SPI_HZ);
+		ws2812_free(ws);
+		free(reference);
+	}
+	return 0;
+}
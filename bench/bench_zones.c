@@ -0,0 +1,52 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "timing.h"
+#include "zone.h"
+
+static double run(struct zone *zones, int num_zones, int frames)
+{
+	timing_clock_init(TIMING_VIRTUAL, 0.01);
+	const struct frame_origin clock = { .source = LATENCY_CLOCK, .time = 0 };
+	const double start = bench_now();
+	for (int i = 0; i < frames; ++i) {
+		struct dirty dirty;
+		struct frame_origin origin = clock;
+		timing_tick();
+		dirty_clear(&dirty);
+		zones_run(zones, num_zones, timing_now(), &clock, &dirty, &origin, NULL, NULL);
+	}
+	return bench_now() - start;
+}
+
+/* Whole strip of rainbow_pulse every frame, then split with the background at 1/10 rate */
+int bench_zones(void)
+{
+	const size_t num_leds = 1000;
+	const int frames = 2000;
+	const struct animation_inputs inputs = { .formula = NULL };
+	struct led *leds = calloc(num_leds, sizeof(*leds));
+	struct zone zones[] = {
+		{ .begin = 0, .num_leds = num_leds, .type = RAINBOW_PULSE },
+		{ .begin = 0, .num_leds = 900, .type = RAINBOW_PULSE, .period = 0.1 },
+		{ .begin = 900, .num_leds = 100, .type = PARTICLES },
+	};
+	if (!leds) {
+		return -1;
+	}
+	for (size_t z = 0; z < sizeof(zones) / sizeof(zones[0]); ++z) {
+		zones[z].animation = animation_init(zones[z].type, zones[z].num_leds, leds + zones[z].begin, &inputs);
+		if (!zones[z].animation) {
+			return -1;
+		}
+	}
+	bench_report("one zone", num_leds, frames, run(zones, 1, frames));
+	bench_report("slow background", num_leds, frames, run(zones + 1, 2, frames));
+	printf("  background rendered %llu of %d frames\n", (unsigned long long) zones[1].renders, frames);
+	for (size_t z = 0; z < sizeof(zones) / sizeof(zones[0]); ++z) {
+		animation_free(zones[z].animation);
+	}
+	free(leds);
+	return 0;
+}
@@ -0,0 +1,215 @@
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "calibration.h"
+
+/* Keeps the fixed-point dot product of three 8-bit inputs within int32_t */
+static const float max_coefficient = 2;
+
+static const char *channel_names[3] = { "red", "green", "blue" };
+
+static int parse_line(struct calibration *this, char *line)
+{
+	char *save;
+	const char *key = strtok_r(line, " \t\r\n", &save);
+	if (!key || key[0] == '#') {
+		return 0;
+	}
+	float values[3];
+	int count = 0;
+	for (const char *token; (token = strtok_r(NULL, " \t\r\n", &save)); ++count) {
+		char *end;
+		if (count == 3) {
+			return -1;
+		}
+		values[count] = strtof(token, &end);
+		if (*end || end == token) {
+			return -1;
+		}
+	}
+	if (strcmp(key, "integer") == 0 && count == 0) {
+		this->integer = true;
+		return 0;
+	}
+	if (strcmp(key, "gamma") == 0 && (count == 1 || count == 3)) {
+		for (int c = 0; c < 3; ++c) {
+			this->gamma[c] = values[count == 1 ? 0 : c];
+			if (!(this->gamma[c] > 0)) {
+				return -1;
+			}
+		}
+		return 0;
+	}
+	for (int c = 0; c < 3; ++c) {
+		if (strcmp(key, channel_names[c]) == 0 && count == 3) {
+			for (int j = 0; j < 3; ++j) {
+				if (!(fabsf(values[j]) <= max_coefficient)) {
+					return -1;
+				}
+				this->matrix[c][j] = values[j];
+			}
+			return 0;
+		}
+	}
+	return -1;
+}
+
+static void precompute(struct calibration *this)
+{
+	const float scale = (CALIBRATION_LUT_SIZE - 1) / 255.0f * 65536;
+	for (int c = 0; c < 3; ++c) {
+		for (int j = 0; j < 3; ++j) {
+			this->fixed[c][j] = lroundf(this->matrix[c][j] * scale);
+		}
+		for (int i = 0; i < CALIBRATION_LUT_SIZE; ++i) {
+			const float linear = i / (float) (CALIBRATION_LUT_SIZE - 1);
+			this->lut[c][i] = lroundf(powf(linear, this->gamma[c]) * 255);
+		}
+	}
+}
+
+struct calibration *calibration_load(const char *path)
+{
+	struct calibration *this = malloc(sizeof(*this));
+	if (!this) {
+		return NULL;
+	}
+	memset(this, 0, sizeof(*this));
+	for (int c = 0; c < 3; ++c) {
+		this->matrix[c][c] = 1;
+		this->gamma[c] = 1;
+	}
+	FILE *f = fopen(path, "r");
+	if (!f) {
+		perror("fopen");
+		goto fail;
+	}
+	char line[256];
+	for (int number = 1; fgets(line, sizeof(line), f); ++number) {
+		if (parse_line(this, line) != 0) {
+			fprintf(stderr, "%s:%d: invalid calibration line\n", path, number);
+			fclose(f);
+			errno = EINVAL;
+			goto fail;
+		}
+	}
+	fclose(f);
+	precompute(this);
+	return this;
+fail:
+	calibration_free(this);
+	return NULL;
+}
+
+/* NaN fails value > 0, so it clamps to 0 instead of reaching the conversion */
+static inline int quantise(float value)
+{
+	return !(value > 0) ? 0 : value > 1 ? 255 : (int) (value * 255 + 0.5f);
+}
+
+static inline uint16_t lut_index(float value)
+{
+	value = !(value > 0) ? 0 : value > 1 ? 1 : value;
+	return value * (CALIBRATION_LUT_SIZE - 1) + 0.5f;
+}
+
+static inline uint16_t fixed_index(int32_t value)
+{
+	value = (value + 0x8000) >> 16;
+	return value < 0 ? 0 : value > CALIBRATION_LUT_SIZE - 1 ? CALIBRATION_LUT_SIZE - 1 : value;
+}
+
+/*
+ * Matrix and clamp into planar LUT indices first, unrolled over channels so
+ * that it vectorises across LEDs, then the gamma lookups, which don't.
+ */
+void calibration_apply(const struct calibration *this, const struct led *leds, size_t count, bool scaled, uint8_t out[3][CALIBRATION_CHUNK])
+{
+	uint16_t index[3][CALIBRATION_CHUNK];
+	float brightness[CALIBRATION_CHUNK];
+	for (size_t k = 0; k < count; ++k) {
+		brightness[k] = scaled ? leds[k].brightness : 1;
+	}
+	if (this->integer) {
+		const int32_t (*m)[3] = this->fixed;
+		for (size_t k = 0; k < count; ++k) {
+			const int32_t r = quantise(leds[k].colour.r * brightness[k]);
+			const int32_t g = quantise(leds[k].colour.g * brightness[k]);
+			const int32_t b = quantise(leds[k].colour.b * brightness[k]);
+			index[0][k] = fixed_index(m[0][0] * r + m[0][1] * g + m[0][2] * b);
+			index[1][k] = fixed_index(m[1][0] * r + m[1][1] * g + m[1][2] * b);
+			index[2][k] = fixed_index(m[2][0] * r + m[2][1] * g + m[2][2] * b);
+		}
+	} else {
+		const float (*m)[3] = this->matrix;
+		for (size_t k = 0; k < count; ++k) {
+			const float r = leds[k].colour.r * brightness[k];
+			const float g = leds[k].colour.g * brightness[k];
+			const float b = leds[k].colour.b * brightness[k];
+			index[0][k] = lut_index(m[0][0] * r + m[0][1] * g + m[0][2] * b);
+			index[1][k] = lut_index(m[1][0] * r + m[1][1] * g + m[1][2] * b);
+			index[2][k] = lut_index(m[2][0] * r + m[2][1] * g + m[2][2] * b);
+		}
+	}
+	for (int c = 0; c < 3; ++c) {
+		for (size_t k = 0; k < count; ++k) {
+			out[c][k] = this->lut[c][index[c][k]];
+		}
+	}
+}
+
+void calibration_apply_linear(const struct calibration *this, const uint8_t in[3], uint16_t out[3])
+{
+	for (int c = 0; c < 3; ++c) {
+		const float *m = this->matrix[c];
+		out[c] = lut_index((m[0] * in[0] + m[1] * in[1] + m[2] * in[2]) / 255);
+	}
+}
+
+void calibration_apply_bytes(const struct calibration *this, const uint8_t in[3], uint8_t out[3])
+{
+	uint16_t index[3];
+	calibration_apply_linear(this, in, index);
+	for (int c = 0; c < 3; ++c) {
+		out[c] = this->lut[c][index[c]];
+	}
+}
+
+int calibration_palette_linear(const struct calibration *this, const struct palette *palette, uint16_t (**indices)[3])
+{
+	uint16_t (*resized)[3] = realloc(*indices, sizeof(**indices) * palette->size);
+	if (!resized) {
+		perror("realloc");
+		return -1;
+	}
+	*indices = resized;
+	for (int i = 0; i < palette->size; ++i) {
+		calibration_apply_linear(this, palette->bytes[i], resized[i]);
+	}
+	return 0;
+}
+
+int calibration_palette(const struct calibration *this, const struct palette *palette, uint8_t (**bytes)[3])
+{
+	uint8_t (*resized)[3] = realloc(*bytes, sizeof(**bytes) * palette->size);
+	if (!resized) {
+		perror("realloc");
+		return -1;
+	}
+	*bytes = resized;
+	for (int i = 0; i < palette->size; ++i) {
+		calibration_apply_bytes(this, palette->bytes[i], resized[i]);
+	}
+	return 0;
+}
+
+void calibration_free(struct calibration *this)
+{
+	if (!this) {
+		return;
+	}
+	free(this);
+}
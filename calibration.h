@@ -0,0 +1,46 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "led.h"
+#include "palette.h"
+
+/* Linear light is quantised to this many bits before the gamma lookup */
+#define CALIBRATION_LUT_BITS 12
+#define CALIBRATION_LUT_SIZE (1 << CALIBRATION_LUT_BITS)
+/* LEDs calibrated per call, so the encoders keep one pass over struct led */
+#define CALIBRATION_CHUNK 64
+
+/*
+ * Per-strip colour correction, loaded from a file of lines:
+ *
+ *   red 1.0 0.0 0.0     <--row of the matrix giving output red from input r, g, b
+ *   green 0.0 0.9 0.0
+ *   blue 0.0 0.05 0.8
+ *   gamma 2.2 2.0 2.4   <--per output channel, or one value for all
+ *   integer             <--fixed-point matrix over 8-bit inputs
+ *
+ * Missing rows default to identity and missing gamma to 1.
+ */
+struct calibration
+{
+	float matrix[3][3];
+	float gamma[3];
+	bool integer;
+	/* Matrix scaled from 0..255 inputs to LUT indices, 16.16 fixed point */
+	int32_t fixed[3][3];
+	/* LUT index to 8-bit wire value, per output channel */
+	uint8_t lut[3][CALIBRATION_LUT_SIZE];
+};
+
+struct calibration *calibration_load(const char *path);
+/* Wire values of up to CALIBRATION_CHUNK LEDs, colour times brightness if scaled */
+void calibration_apply(const struct calibration *this, const struct led *leds, size_t count, bool scaled, uint8_t out[3][CALIBRATION_CHUNK]);
+/* LUT indices, before gamma, for callers that scale the light first */
+void calibration_apply_linear(const struct calibration *this, const uint8_t in[3], uint16_t out[3]);
+void calibration_apply_bytes(const struct calibration *this, const uint8_t in[3], uint8_t out[3]);
+/* Calibrated copy of a palette, reallocated to its size, as wire bytes or LUT indices */
+int calibration_palette(const struct calibration *this, const struct palette *palette, uint8_t (**bytes)[3]);
+int calibration_palette_linear(const struct calibration *this, const struct palette *palette, uint16_t (**indices)[3]);
+void calibration_free(struct calibration *this);
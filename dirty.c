@@ -0,0 +1,83 @@
+#include <string.h>
+
+#include "dirty.h"
+
+void dirty_clear(struct dirty *this)
+{
+	this->num_spans = 0;
+}
+
+void dirty_all(struct dirty *this, size_t num_leds)
+{
+	dirty_clear(this);
+	dirty_add(this, 0, num_leds);
+}
+
+/* Coalesce the two spans with the smallest gap between them */
+static void merge_closest(struct dirty *this)
+{
+	int best = 0;
+	for (int i = 1; i < this->num_spans - 1; ++i) {
+		if (this->spans[i + 1].begin - this->spans[i].end <
+				this->spans[best + 1].begin - this->spans[best].end) {
+			best = i;
+		}
+	}
+	this->spans[best].end = this->spans[best + 1].end;
+	memmove(this->spans + best + 1, this->spans + best + 2,
+			sizeof(*this->spans) * (this->num_spans - best - 2));
+	this->num_spans--;
+}
+
+void dirty_add(struct dirty *this, size_t begin, size_t end)
+{
+	if (begin >= end) {
+		return;
+	}
+	/* Spans [i, j) overlap or touch the new one */
+	int i = 0;
+	while (i < this->num_spans && this->spans[i].end < begin) {
+		++i;
+	}
+	int j = i;
+	while (j < this->num_spans && this->spans[j].begin <= end) {
+		if (this->spans[j].begin < begin) {
+			begin = this->spans[j].begin;
+		}
+		if (this->spans[j].end > end) {
+			end = this->spans[j].end;
+		}
+		++j;
+	}
+	if (i == j) {
+		if (this->num_spans == DIRTY_MAX_SPANS) {
+			merge_closest(this);
+			dirty_add(this, begin, end);
+			return;
+		}
+		memmove(this->spans + i + 1, this->spans + i,
+				sizeof(*this->spans) * (this->num_spans - i));
+		this->num_spans++;
+	} else {
+		memmove(this->spans + i + 1, this->spans + j,
+				sizeof(*this->spans) * (this->num_spans - j));
+		this->num_spans -= j - i - 1;
+	}
+	this->spans[i] = (struct span) { .begin = begin, .end = end };
+}
+
+void dirty_merge(struct dirty *this, const struct dirty *other)
+{
+	FOREACH_DIRTY_SPAN(other, span) {
+		dirty_add(this, span->begin, span->end);
+	}
+}
+
+size_t dirty_count(const struct dirty *this)
+{
+	size_t count = 0;
+	FOREACH_DIRTY_SPAN(this, span) {
+		count += span->end - span->begin;
+	}
+	return count;
+}
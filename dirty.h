@@ -0,0 +1,26 @@
+#pragma once
+#include <stddef.h>
+
+#define DIRTY_MAX_SPANS 64
+
+/* [begin, end) */
+struct span
+{
+	size_t begin;
+	size_t end;
+};
+
+/* Sorted, disjoint set of LED ranges which changed since last encoded */
+struct dirty
+{
+	int num_spans;
+	struct span spans[DIRTY_MAX_SPANS];
+};
+
+void dirty_clear(struct dirty *this);
+void dirty_all(struct dirty *this, size_t num_leds);
+void dirty_add(struct dirty *this, size_t begin, size_t end);
+void dirty_merge(struct dirty *this, const struct dirty *other);
+size_t dirty_count(const struct dirty *this);
+
+#define FOREACH_DIRTY_SPAN(dirty, it) for (const struct span *it = (dirty)->spans, *it##_end = it + (dirty)->num_spans; it != it##_end; ++it)
@@ -0,0 +1,618 @@
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "expr.h"
+#include "util.h"
+
+/*
+ * Grammar:
+ *   program   := { name '=' sum ';' } result
+ *   result    := 'hsv' '(' sum ',' sum ',' sum ')'
+ *              | 'rgb' '(' sum ',' sum ',' sum ')'
+ *              | sum
+ *   sum       := product { ('+' | '-') product }
+ *   product   := unary { ('*' | '/' | '%') unary }
+ *   unary     := '-' unary | power
+ *   power     := primary [ '^' unary ]
+ *   primary   := number | name | name '(' sum { ',' sum } ')' | '(' sum ')'
+ *
+ * Names: i (LED index), t (seconds), n (number of LEDs), pi, and bindings.
+ */
+
+static inline float fract(float x)
+{
+	return x - floorf(x);
+}
+
+static inline float hsv_channel(float k0, float h, float s, float v)
+{
+	/* Branchless hsv2rgb, one channel */
+	float k = k0 + fract(h) * 6;
+	k = k >= 6 ? k - 6 : k;
+	float x = clampf(0, 1, fminf(k, 4 - k));
+	s = clampf(0, 1, s);
+	v = clampf(0, 1, v);
+	return v - v * s * x;
+}
+
+/* code, function name, arity, value */
+#define EXPR_OPS(X) \
+	X(ADD, NULL, 2, a + b) \
+	X(SUB, NULL, 2, a - b) \
+	X(MUL, NULL, 2, a * b) \
+	X(DIV, NULL, 2, a / b) \
+	X(NEG, NULL, 1, -a) \
+	X(MOD, "mod", 2, fmodf(a, b)) \
+	X(POW, "pow", 2, powf(a, b)) \
+	X(SIN, "sin", 1, sinf(a)) \
+	X(COS, "cos", 1, cosf(a)) \
+	X(TAN, "tan", 1, tanf(a)) \
+	X(EXP, "exp", 1, expf(a)) \
+	X(LOG, "log", 1, logf(a)) \
+	X(SQRT, "sqrt", 1, sqrtf(a)) \
+	X(ABS, "abs", 1, fabsf(a)) \
+	X(FLOOR, "floor", 1, floorf(a)) \
+	X(FRACT, "fract", 1, fract(a)) \
+	X(MIN, "min", 2, fminf(a, b)) \
+	X(MAX, "max", 2, fmaxf(a, b)) \
+	X(CLAMP, "clamp", 3, clampf(b, c, a)) \
+	X(MIX, "mix", 3, interpf(a, b, c)) \
+	X(STEP, "step", 2, b >= a ? 1.0f : 0.0f) \
+	X(HSV_R, NULL, 3, hsv_channel(5, a, b, c)) \
+	X(HSV_G, NULL, 3, hsv_channel(3, a, b, c)) \
+	X(HSV_B, NULL, 3, hsv_channel(1, a, b, c))
+
+enum expr_code
+{
+#define X(code, name, arity, value) OP_##code,
+	EXPR_OPS(X)
+#undef X
+};
+
+static const struct
+{
+	const char *name;
+	int arity;
+} op_info[] = {
+#define X(code, name, arity, value) { name, arity },
+	EXPR_OPS(X)
+#undef X
+};
+
+static float op_fold(int code, float a, float b, float c)
+{
+	(void) b;
+	(void) c;
+	switch (code) {
+#define X(code, name, arity, value) case OP_##code: return value;
+	EXPR_OPS(X)
+#undef X
+	}
+	return NAN;
+}
+
+enum
+{
+	REG_I = 0,
+	REG_T = 1,
+	REG_N = 2,
+	NUM_INPUT_REGS = 3
+};
+
+struct operand
+{
+	int is_const;
+	float value;
+	int reg;
+	int temp;
+};
+
+struct binding
+{
+	char name[16];
+	struct operand value;
+};
+
+struct parser
+{
+	const char *source;
+	const char *pos;
+	int error;
+	struct expr *expr;
+	unsigned long long live;
+	unsigned long long used;
+	int num_bindings;
+	struct binding bindings[EXPR_MAX_BINDINGS];
+};
+
+static void parse_error(struct parser *p, const char *message)
+{
+	if (p->error) {
+		return;
+	}
+	fprintf(stderr, "expr: %s at column %d\n", message, (int) (p->pos - p->source) + 1);
+	p->error = 1;
+}
+
+static void skip_space(struct parser *p)
+{
+	while (isspace((unsigned char) *p->pos)) {
+		++p->pos;
+	}
+}
+
+static int accept(struct parser *p, char c)
+{
+	skip_space(p);
+	if (*p->pos == c) {
+		++p->pos;
+		return 1;
+	}
+	return 0;
+}
+
+static void expect(struct parser *p, char c)
+{
+	if (!accept(p, c)) {
+		char message[32];
+		snprintf(message, sizeof(message), "expected '%c'", c);
+		parse_error(p, message);
+	}
+}
+
+static size_t read_name(struct parser *p, char *name, size_t size)
+{
+	skip_space(p);
+	size_t len = 0;
+	if (!isalpha((unsigned char) *p->pos) && *p->pos != '_') {
+		return 0;
+	}
+	while (isalnum((unsigned char) p->pos[len]) || p->pos[len] == '_') {
+		++len;
+	}
+	if (len >= size) {
+		parse_error(p, "name too long");
+		return 0;
+	}
+	memcpy(name, p->pos, len);
+	name[len] = 0;
+	p->pos += len;
+	return len;
+}
+
+static struct operand constant(float value)
+{
+	return (struct operand) { .is_const = 1, .value = value };
+}
+
+static struct operand reg(int reg)
+{
+	return (struct operand) { .reg = reg };
+}
+
+/* Constant registers are filled once at compile-time, so must never have held a temporary */
+static int alloc_reg(struct parser *p, int fresh)
+{
+	const unsigned long long taken = fresh ? p->used : p->live;
+	for (int r = NUM_INPUT_REGS; r < EXPR_MAX_REGS; ++r) {
+		if (!(taken & (1ull << r))) {
+			p->live |= 1ull << r;
+			p->used |= 1ull << r;
+			if (r >= p->expr->num_regs) {
+				p->expr->num_regs = r + 1;
+			}
+			return r;
+		}
+	}
+	parse_error(p, "expression too complex");
+	return 0;
+}
+
+static void release(struct parser *p, const struct operand *op)
+{
+	if (!op->is_const && op->temp) {
+		p->live &= ~(1ull << op->reg);
+	}
+}
+
+/* Constants are loaded into permanent registers once, at compile-time */
+static int materialise(struct parser *p, const struct operand *op)
+{
+	if (!op->is_const) {
+		return op->reg;
+	}
+	struct expr *e = p->expr;
+	for (int i = 0; i < e->num_consts; ++i) {
+		if (e->consts[i].value == op->value) {
+			return e->consts[i].reg;
+		}
+	}
+	int r = alloc_reg(p, 1);
+	if (p->error) {
+		return 0;
+	}
+	e->consts[e->num_consts++] = (struct expr_const) { .reg = r, .value = op->value };
+	return r;
+}
+
+static void push_op(struct parser *p, int code, int dst, const int *args)
+{
+	struct expr *e = p->expr;
+	if (e->num_ops == EXPR_MAX_OPS) {
+		parse_error(p, "expression too long");
+		return;
+	}
+	e->ops[e->num_ops++] = (struct expr_op) {
+		.code = code,
+		.dst = dst,
+		.a = args[0],
+		.b = args[1],
+		.c = args[2]
+	};
+}
+
+static struct operand emit(struct parser *p, int code, const struct operand *args)
+{
+	const int arity = op_info[code].arity;
+	int all_const = 1;
+	for (int i = 0; i < arity; ++i) {
+		all_const &= args[i].is_const;
+	}
+	if (all_const) {
+		return constant(op_fold(code, args[0].value, args[1].value, args[2].value));
+	}
+	int regs[3] = { 0, 0, 0 };
+	for (int i = 0; i < arity; ++i) {
+		regs[i] = materialise(p, &args[i]);
+	}
+	/* Element-wise ops may write in-place over their temporary inputs */
+	for (int i = 0; i < arity; ++i) {
+		release(p, &args[i]);
+	}
+	struct operand result = reg(alloc_reg(p, 0));
+	result.temp = 1;
+	push_op(p, code, result.reg, regs);
+	return result;
+}
+
+/* Strength-reduce x^e for small integer e to square-and-multiply */
+static struct operand emit_powi(struct parser *p, const struct operand *base, int e)
+{
+	if (e == 1) {
+		return *base;
+	}
+	struct operand half = emit_powi(p, base, e / 2);
+	struct operand args[3] = { half, half, constant(0) };
+	struct operand result = emit(p, OP_MUL, args);
+	if (e & 1) {
+		struct operand odd[3] = { result, *base, constant(0) };
+		result = emit(p, OP_MUL, odd);
+	}
+	return result;
+}
+
+static struct operand emit_binary(struct parser *p, int code, struct operand lhs, struct operand rhs)
+{
+	if (!lhs.is_const && rhs.is_const) {
+		if (code == OP_DIV && rhs.value != 0) {
+			code = OP_MUL;
+			rhs.value = 1 / rhs.value;
+		} else if (code == OP_POW && rhs.value == (int) rhs.value && rhs.value >= 1 && rhs.value <= 16) {
+			/* Base must stay live until the last multiply */
+			const int temp = lhs.temp;
+			lhs.temp = 0;
+			struct operand result = emit_powi(p, &lhs, rhs.value);
+			if (temp && (result.is_const || result.reg != lhs.reg)) {
+				lhs.temp = 1;
+				release(p, &lhs);
+			}
+			return result;
+		}
+	}
+	struct operand args[3] = { lhs, rhs, constant(0) };
+	return emit(p, code, args);
+}
+
+static struct operand parse_sum(struct parser *p);
+static struct operand parse_unary(struct parser *p);
+
+static struct operand parse_call(struct parser *p, const char *name)
+{
+	int code = -1;
+	for (size_t i = 0; i < sizeof(op_info) / sizeof(op_info[0]); ++i) {
+		if (op_info[i].name && strcmp(op_info[i].name, name) == 0) {
+			code = i;
+			break;
+		}
+	}
+	if (code < 0) {
+		parse_error(p, strcmp(name, "hsv") == 0 || strcmp(name, "rgb") == 0 ?
+				"colour function must be the final result" :
+				"unknown function");
+		return constant(0);
+	}
+	struct operand args[3] = { constant(0), constant(0), constant(0) };
+	for (int i = 0; i < op_info[code].arity; ++i) {
+		if (i > 0) {
+			expect(p, ',');
+		}
+		args[i] = parse_sum(p);
+	}
+	expect(p, ')');
+	if (op_info[code].arity == 2) {
+		return emit_binary(p, code, args[0], args[1]);
+	}
+	return emit(p, code, args);
+}
+
+static struct operand parse_primary(struct parser *p)
+{
+	if (p->error) {
+		return constant(0);
+	}
+	if (accept(p, '(')) {
+		struct operand result = parse_sum(p);
+		expect(p, ')');
+		return result;
+	}
+	char name[16];
+	if (read_name(p, name, sizeof(name))) {
+		if (accept(p, '(')) {
+			return parse_call(p, name);
+		}
+		for (int i = p->num_bindings - 1; i >= 0; --i) {
+			if (strcmp(p->bindings[i].name, name) == 0) {
+				return p->bindings[i].value;
+			}
+		}
+		if (strcmp(name, "i") == 0) {
+			return reg(REG_I);
+		} else if (strcmp(name, "t") == 0) {
+			return reg(REG_T);
+		} else if (strcmp(name, "n") == 0) {
+			return reg(REG_N);
+		} else if (strcmp(name, "pi") == 0) {
+			return constant(M_PI);
+		}
+		parse_error(p, "unknown name");
+		return constant(0);
+	}
+	char *end;
+	float value = strtof(p->pos, &end);
+	if (end == p->pos) {
+		parse_error(p, "expected expression");
+		return constant(0);
+	}
+	p->pos = end;
+	return constant(value);
+}
+
+static struct operand parse_power(struct parser *p)
+{
+	struct operand base = parse_primary(p);
+	if (accept(p, '^')) {
+		return emit_binary(p, OP_POW, base, parse_unary(p));
+	}
+	return base;
+}
+
+static struct operand parse_unary(struct parser *p)
+{
+	if (accept(p, '-')) {
+		struct operand args[3] = { parse_unary(p), constant(0), constant(0) };
+		return emit(p, OP_NEG, args);
+	}
+	return parse_power(p);
+}
+
+static struct operand parse_product(struct parser *p)
+{
+	struct operand lhs = parse_unary(p);
+	while (!p->error) {
+		int code;
+		if (accept(p, '*')) {
+			code = OP_MUL;
+		} else if (accept(p, '/')) {
+			code = OP_DIV;
+		} else if (accept(p, '%')) {
+			code = OP_MOD;
+		} else {
+			break;
+		}
+		lhs = emit_binary(p, code, lhs, parse_unary(p));
+	}
+	return lhs;
+}
+
+static struct operand parse_sum(struct parser *p)
+{
+	struct operand lhs = parse_product(p);
+	while (!p->error) {
+		int code;
+		if (accept(p, '+')) {
+			code = OP_ADD;
+		} else if (accept(p, '-')) {
+			code = OP_SUB;
+		} else {
+			break;
+		}
+		lhs = emit_binary(p, code, lhs, parse_product(p));
+	}
+	return lhs;
+}
+
+static void parse_result(struct parser *p)
+{
+	struct expr *e = p->expr;
+	const char *start = p->pos;
+	char name[16];
+	int colour = 0;
+	if (read_name(p, name, sizeof(name)) && accept(p, '(') &&
+			(strcmp(name, "hsv") == 0 || strcmp(name, "rgb") == 0)) {
+		colour = strcmp(name, "hsv") == 0 ? 1 : 2;
+	} else {
+		p->pos = start;
+	}
+	if (!colour) {
+		struct operand value = parse_sum(p);
+		e->out_r = e->out_g = e->out_b = materialise(p, &value);
+		return;
+	}
+	struct operand args[3];
+	for (int i = 0; i < 3; ++i) {
+		if (i > 0) {
+			expect(p, ',');
+		}
+		args[i] = parse_sum(p);
+	}
+	expect(p, ')');
+	if (colour == 1) {
+		/* Inputs stay live until all three channels are emitted */
+		struct operand out[3];
+		for (int i = 0; i < 3; ++i) {
+			if (args[0].is_const && args[1].is_const && args[2].is_const) {
+				out[i] = constant(op_fold(OP_HSV_R + i, args[0].value, args[1].value, args[2].value));
+				continue;
+			}
+			int regs[3];
+			for (int j = 0; j < 3; ++j) {
+				regs[j] = materialise(p, &args[j]);
+			}
+			out[i] = reg(alloc_reg(p, 0));
+			push_op(p, OP_HSV_R + i, out[i].reg, regs);
+		}
+		memcpy(args, out, sizeof(out));
+	}
+	e->out_r = materialise(p, &args[0]);
+	e->out_g = materialise(p, &args[1]);
+	e->out_b = materialise(p, &args[2]);
+}
+
+static void parse_program(struct parser *p)
+{
+	while (!p->error) {
+		const char *start = p->pos;
+		char name[16];
+		if (!read_name(p, name, sizeof(name)) || !accept(p, '=')) {
+			p->pos = start;
+			break;
+		}
+		struct operand value = parse_sum(p);
+		expect(p, ';');
+		if (p->num_bindings == EXPR_MAX_BINDINGS) {
+			parse_error(p, "too many bindings");
+			break;
+		}
+		/* Bound registers are never released */
+		value.temp = 0;
+		struct binding *b = &p->bindings[p->num_bindings++];
+		strcpy(b->name, name);
+		b->value = value;
+	}
+	parse_result(p);
+	skip_space(p);
+	if (*p->pos) {
+		parse_error(p, "unexpected input");
+	}
+}
+
+struct expr *expr_compile(const char *source)
+{
+	struct expr *this = malloc(sizeof(*this));
+	if (!this) {
+		perror("malloc");
+		goto fail;
+	}
+	memset(this, 0, sizeof(*this));
+	this->num_regs = NUM_INPUT_REGS;
+	struct parser p = {
+		.source = source,
+		.pos = source,
+		.expr = this,
+		.live = (1ull << NUM_INPUT_REGS) - 1,
+		.used = (1ull << NUM_INPUT_REGS) - 1
+	};
+	parse_program(&p);
+	if (p.error) {
+		goto fail;
+	}
+	this->regs = malloc(sizeof(*this->regs) * this->num_regs);
+	if (!this->regs) {
+		perror("malloc");
+		goto fail;
+	}
+	for (int i = 0; i < this->num_consts; ++i) {
+		for (int k = 0; k < EXPR_CHUNK; ++k) {
+			this->regs[this->consts[i].reg][k] = this->consts[i].value;
+		}
+	}
+	return this;
+fail:
+	expr_free(this);
+	return NULL;
+}
+
+static void run_ops(struct expr *this)
+{
+	float (*regs)[EXPR_CHUNK] = this->regs;
+	for (const struct expr_op *op = this->ops, *end = op + this->num_ops; op != end; ++op) {
+		float *d = regs[op->dst];
+		const float *ra = regs[op->a];
+		const float *rb = regs[op->b];
+		const float *rc = regs[op->c];
+		switch (op->code) {
+#define X(code, name, arity, value) \
+		case OP_##code: \
+			for (int k = 0; k < EXPR_CHUNK; ++k) { \
+				const float a = ra[k]; \
+				const float b = rb[k]; \
+				const float c = rc[k]; \
+				(void) b; \
+				(void) c; \
+				d[k] = value; \
+			} \
+			break;
+		EXPR_OPS(X)
+#undef X
+		}
+	}
+}
+
+void expr_eval(struct expr *this, float t, size_t num_leds, size_t begin, size_t end, struct led *leds)
+{
+	float (*regs)[EXPR_CHUNK] = this->regs;
+	for (int k = 0; k < EXPR_CHUNK; ++k) {
+		regs[REG_T][k] = t;
+		regs[REG_N][k] = num_leds;
+	}
+	for (size_t base = begin; base < end; base += EXPR_CHUNK) {
+		for (int k = 0; k < EXPR_CHUNK; ++k) {
+			regs[REG_I][k] = base + k;
+		}
+		run_ops(this);
+		const float *r = regs[this->out_r];
+		const float *g = regs[this->out_g];
+		const float *b = regs[this->out_b];
+		struct led *led = leds + base;
+		for (size_t k = 0, count = end - base < EXPR_CHUNK ? end - base : EXPR_CHUNK; k < count; ++k) {
+			led[k].brightness = 1;
+			led[k].colour.r = r[k];
+			led[k].colour.g = g[k];
+			led[k].colour.b = b[k];
+		}
+	}
+}
+
+void expr_free(struct expr *this)
+{
+	if (!this) {
+		return;
+	}
+	if (this->regs) {
+		free(this->regs);
+	}
+	free(this);
+}
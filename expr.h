@@ -0,0 +1,49 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include "led.h"
+
+/* Number of LEDs evaluated per batch, each register holds one batch */
+#define EXPR_CHUNK 64
+#define EXPR_MAX_REGS 64
+#define EXPR_MAX_OPS 256
+#define EXPR_MAX_BINDINGS 16
+
+struct expr_op
+{
+	uint8_t code;
+	uint8_t dst;
+	uint8_t a;
+	uint8_t b;
+	uint8_t c;
+};
+
+struct expr_const
+{
+	uint8_t reg;
+	float value;
+};
+
+/*
+ * Expression over (i, t, n) compiled to register bytecode.
+ *
+ * Registers 0..2 are the inputs i, t, n.  The result is in registers
+ * out_r, out_g, out_b.
+ */
+struct expr
+{
+	int num_ops;
+	struct expr_op ops[EXPR_MAX_OPS];
+	int num_consts;
+	struct expr_const consts[EXPR_MAX_REGS];
+	int num_regs;
+	uint8_t out_r;
+	uint8_t out_g;
+	uint8_t out_b;
+	float (*regs)[EXPR_CHUNK];
+};
+
+struct expr *expr_compile(const char *source);
+void expr_eval(struct expr *this, float t, size_t num_leds, size_t begin, size_t end, struct led *leds);
+void expr_free(struct expr *this);
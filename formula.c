@@ -0,0 +1,46 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "formula.h"
+
+struct formula *formula_init(size_t num_leds, struct led *leds, const char *source)
+{
+	struct formula *this = malloc(sizeof(*this));
+	if (!this) {
+		perror("malloc");
+		goto fail;
+	}
+	memset(this, 0, sizeof(*this));
+	if (timing_init(&this->timing) != 0) {
+		perror("timing_init");
+		goto fail;
+	}
+	this->num_leds = num_leds;
+	this->leds = leds;
+	this->time = 0;
+	this->expr = expr_compile(source);
+	if (!this->expr) {
+		fprintf(stderr, "Failed to compile expression: %s\n", source);
+		goto fail;
+	}
+	return this;
+fail:
+	formula_free(this);
+	return NULL;
+}
+
+void formula_run(struct formula *this)
+{
+	this->time += timing_step(&this->timing);
+	expr_eval(this->expr, this->time, this->num_leds, 0, this->num_leds, this->leds);
+}
+
+void formula_free(struct formula *this)
+{
+	if (!this) {
+		return;
+	}
+	expr_free(this->expr);
+	free(this);
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "led.h"
+#include "timing.h"
+#include "expr.h"
+
+struct formula
+{
+	size_t num_leds;
+	struct led *leds;
+	struct timing timing;
+	struct expr *expr;
+	double time;
+};
+
+struct formula *formula_init(size_t num_leds, struct led *leds, const char *source);
+void formula_run(struct formula *this);
+void formula_free(struct formula *this);
@@ -0,0 +1,148 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "interp.h"
+#include "util.h"
+
+static double monotonic(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+struct interp *interp_init(size_t num_leds, int divider)
+{
+	struct interp *this = malloc(sizeof(*this));
+	if (!this) {
+		perror("malloc");
+		goto fail;
+	}
+	memset(this, 0, sizeof(*this));
+	this->num_leds = num_leds;
+	this->divider = divider;
+	this->requested_divider = divider;
+	this->older = calloc(num_leds, sizeof(*this->older));
+	this->prev = calloc(num_leds, sizeof(*this->prev));
+	this->next = calloc(num_leds, sizeof(*this->next));
+	if (!this->older || !this->prev || !this->next) {
+		perror("calloc");
+		goto fail;
+	}
+	return this;
+fail:
+	interp_free(this);
+	return NULL;
+}
+
+static float level(const struct led *led, float channel)
+{
+	return led->brightness * channel;
+}
+
+/*
+ * Linear interpolation error is bounded by 1/8 of the second difference
+ * of the signal over a tick, which we can measure from the last three
+ * simulated frames.
+ */
+static void measure_error(struct interp *this)
+{
+	float sum = 0;
+	float max = 0;
+	for (size_t i = 0; i < this->num_leds; ++i) {
+		const struct led *a = &this->older[i];
+		const struct led *b = &this->prev[i];
+		const struct led *c = &this->next[i];
+		float r = level(c, c->colour.r) - 2 * level(b, b->colour.r) + level(a, a->colour.r);
+		float g = level(c, c->colour.g) - 2 * level(b, b->colour.g) + level(a, a->colour.g);
+		float bl = level(c, c->colour.b) - 2 * level(b, b->colour.b) + level(a, a->colour.b);
+		float e = fmaxf(fabsf(r), fmaxf(fabsf(g), fabsf(bl))) / 8;
+		sum += e;
+		max = fmaxf(max, e);
+	}
+	this->error_sum += sum / this->num_leds;
+	this->error_max = fmax(this->error_max, max);
+	this->error_count++;
+}
+
+static void tick(struct interp *this, int (*update)(void *), void *state)
+{
+	/* The animation holds on to next, so rotate the other two */
+	struct led *tmp = this->older;
+	this->older = this->prev;
+	this->prev = tmp;
+	memcpy(this->prev, this->next, sizeof(*this->next) * this->num_leds);
+	double start = monotonic();
+	update(state);
+	this->sim_time += monotonic() - start;
+	/* The first two ticks have no history, and nothing is interpolated at 1:1 */
+	if (++this->sim_ticks > 2 && this->divider > 1) {
+		measure_error(this);
+	}
+}
+
+void interp_run(struct interp *this, int (*update)(void *), void *state, struct led *out)
+{
+	if (this->phase == 0) {
+		this->divider = this->requested_divider;
+		tick(this, update, state);
+	}
+	double start = monotonic();
+	this->phase++;
+	const float alpha = this->phase * 1.0f / this->divider;
+	if (this->divider == 1) {
+		memcpy(out, this->next, sizeof(*out) * this->num_leds);
+	} else {
+		for (size_t i = 0; i < this->num_leds; ++i) {
+			const struct led *a = &this->prev[i];
+			const struct led *b = &this->next[i];
+			struct led *led = &out[i];
+			led->brightness = interpf(a->brightness, b->brightness, alpha);
+			led->colour.r = interpf(a->colour.r, b->colour.r, alpha);
+			led->colour.g = interpf(a->colour.g, b->colour.g, alpha);
+			led->colour.b = interpf(a->colour.b, b->colour.b, alpha);
+		}
+	}
+	if (this->phase == this->divider) {
+		this->phase = 0;
+	}
+	this->blend_time += monotonic() - start;
+	this->frames++;
+}
+
+void interp_set_divider(struct interp *this, int divider)
+{
+	this->requested_divider = divider;
+}
+
+void interp_report(const struct interp *this)
+{
+	if (!this->sim_ticks) {
+		return;
+	}
+	const double sim_cost = this->sim_time / this->sim_ticks;
+	const double full_rate = sim_cost * this->frames;
+	const double actual = this->sim_time + this->blend_time;
+	fprintf(stderr, "Interpolation: 1 in %d frames simulated, %.1f us per tick, %.1f us per blend\n",
+			this->divider, sim_cost * 1e6, this->blend_time / this->frames * 1e6);
+	fprintf(stderr, "Interpolation: %.0f%% CPU saved against simulating every frame\n",
+			full_rate > 0 ? (1 - actual / full_rate) * 100 : 0);
+	if (this->error_count) {
+		fprintf(stderr, "Interpolation: estimated error mean %.4f, max %.4f (0..1 per channel)\n",
+				this->error_sum / this->error_count, this->error_max);
+	}
+}
+
+void interp_free(struct interp *this)
+{
+	if (!this) {
+		return;
+	}
+	free(this->older);
+	free(this->prev);
+	free(this->next);
+	free(this);
+}
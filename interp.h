@@ -0,0 +1,37 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include "led.h"
+
+/*
+ * Runs the animation every divider-th output frame and blends linearly
+ * between the last two simulated frames in between.  Output lags the
+ * simulation by one simulation tick.
+ */
+struct interp
+{
+	size_t num_leds;
+	int divider;
+	/* Takes effect at the next simulation tick */
+	int requested_divider;
+	int phase;
+	/* Simulated frames k-2, k-1; the animation renders frame k into next */
+	struct led *older;
+	struct led *prev;
+	struct led *next;
+	/* Statistics */
+	uint64_t frames;
+	uint64_t sim_ticks;
+	double sim_time;
+	double blend_time;
+	double error_sum;
+	double error_max;
+	uint64_t error_count;
+};
+
+struct interp *interp_init(size_t num_leds, int divider);
+void interp_run(struct interp *this, int (*update)(void *), void *state, struct led *out);
+void interp_set_divider(struct interp *this, int divider);
+void interp_report(const struct interp *this);
+void interp_free(struct interp *this);
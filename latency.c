@@ -0,0 +1,97 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "latency.h"
+
+static const char *source_names[LATENCY_SOURCES] = { "clock", "audio", "E1.31", "Art-Net" };
+
+struct latency *latency_init(void)
+{
+	struct latency *this = malloc(sizeof(*this));
+	if (!this) {
+		perror("malloc");
+		goto fail;
+	}
+	memset(this, 0, sizeof(*this));
+	return this;
+fail:
+	latency_free(this);
+	return NULL;
+}
+
+static int bucket(double seconds)
+{
+	const double us = seconds * 1e6;
+	if (us < 1) {
+		return 0;
+	}
+	const int index = 4 * log2(us);
+	return index < LATENCY_BUCKETS ? index : LATENCY_BUCKETS - 1;
+}
+
+/* Upper edge of the bucket holding the given fraction of frames */
+static double percentile(const struct latency *this, enum latency_source source, double fraction)
+{
+	const uint64_t rank = ceil(this->frames[source] * fraction);
+	uint64_t seen = 0;
+	for (int i = 0; i < LATENCY_BUCKETS; ++i) {
+		seen += this->histogram[source][i];
+		if (seen >= rank) {
+			return fmin(exp2((i + 1) / 4.0) * 1e-6, this->max[source]);
+		}
+	}
+	return this->max[source];
+}
+
+void latency_record(struct latency *this, const struct frame_origin *origin, double sent)
+{
+	if (!this || !origin->time) {
+		return;
+	}
+	const double latency = sent - origin->time;
+	this->frames[origin->source]++;
+	this->total[origin->source] += latency;
+	if (latency > this->max[origin->source]) {
+		this->max[origin->source] = latency;
+	}
+	this->histogram[origin->source][bucket(latency)]++;
+}
+
+void latency_superseded(struct latency *this, enum latency_source source)
+{
+	if (!this) {
+		return;
+	}
+	this->superseded[source]++;
+}
+
+void latency_report(const struct latency *this)
+{
+	for (int s = 0; s < LATENCY_SOURCES; ++s) {
+		if (!this->frames[s] && !this->superseded[s]) {
+			continue;
+		}
+		fprintf(stderr, "Latency: %s, %llu frames sent, %llu superseded",
+				source_names[s],
+				(unsigned long long) this->frames[s],
+				(unsigned long long) this->superseded[s]);
+		if (this->frames[s]) {
+			fprintf(stderr, ", mean %.2f ms, p50 < %.2f ms, p99 < %.2f ms, max %.2f ms",
+					this->total[s] / this->frames[s] * 1e3,
+					percentile(this, s, 0.5) * 1e3,
+					percentile(this, s, 0.99) * 1e3,
+					this->max[s] * 1e3);
+		}
+		fprintf(stderr, "\n");
+	}
+}
+
+void latency_free(struct latency *this)
+{
+	if (!this) {
+		return;
+	}
+	free(this);
+}
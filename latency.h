@@ -0,0 +1,46 @@
+#pragma once
+#include <stdint.h>
+
+/* Quarter-octave buckets of microseconds, up to 16s */
+#define LATENCY_BUCKETS 96
+
+/* Where a frame's timestamp origin comes from */
+enum latency_source
+{
+	/* Animation clock, sampled when the frame started */
+	LATENCY_CLOCK = 0,
+	/* Arrival of the audio block the frame reacts to */
+	LATENCY_AUDIO = 1,
+	/* Kernel receive time of the packet that completed the frame */
+	LATENCY_E131 = 2,
+	LATENCY_ARTNET = 3,
+	LATENCY_SOURCES = 4,
+};
+
+/* Carried with a frame from its origin until its wire buffer is written */
+struct frame_origin
+{
+	enum latency_source source;
+	/* CLOCK_MONOTONIC seconds, 0 if the frame carries nothing new */
+	double time;
+};
+
+/*
+ * Input-to-photon latency, from each frame's origin to completion of the
+ * write() that sent it, kept as a distribution per source.
+ */
+struct latency
+{
+	uint64_t frames[LATENCY_SOURCES];
+	/* Replaced by a newer frame before being sent */
+	uint64_t superseded[LATENCY_SOURCES];
+	double total[LATENCY_SOURCES];
+	double max[LATENCY_SOURCES];
+	uint64_t histogram[LATENCY_SOURCES][LATENCY_BUCKETS];
+};
+
+struct latency *latency_init(void);
+void latency_record(struct latency *this, const struct frame_origin *origin, double sent);
+void latency_superseded(struct latency *this, enum latency_source source);
+void latency_report(const struct latency *this);
+void latency_free(struct latency *this);
@@ -9,6 +9,27 @@
 static const float time_wavelength = -0.8;
 static const float space_wavelength = 40;
 static const float threshold = 0.8;
+/* Samples per period of the wave */
+static const int wave_size = 2048;
+
+static void shape(float u, struct led *led)
+{
+	float arg = sinf(2 * M_PI * u);
+	arg = arg < threshold ? 0 : powf((arg - threshold) / (1 - threshold), 8);
+	led->brightness = 1;
+	struct hsv hsv = {
+		.h = 0.6,
+		.s = 1 - powf(arg, 4),
+		.v = arg
+	};
+	hsv2rgb(&hsv, &led->colour);
+}
+
+static float offset(size_t i, size_t num_leds)
+{
+	float space = powf(i * 1.0f / num_leds, 0.1f) * num_leds;
+	return space / space_wavelength;
+}
 
 struct launch *launch_init(size_t num_leds, struct led *leds)
 {
@@ -25,6 +46,13 @@ struct launch *launch_init(size_t num_leds, struct led *leds)
 	this->num_leds = num_leds;
 	this->leds = leds;
 	this->time_phase = 0;
+	this->wave = wavetable_init(num_leds, leds, wave_size, shape, offset);
+	if (!this->wave) {
+		perror("wavetable_init");
+		goto fail;
+	}
+	/* First frame clears the whole strip */
+	dirty_all(&this->lit, num_leds);
 	return this;
 fail:
 	launch_free(this);
@@ -36,23 +64,73 @@ static void step_phase(float *phase, float dt, float wavelength)
 	*phase = fmodf(*phase + dt / wavelength, M_PI * 2);
 }
 
+/*
+ * sin(2.pi.u) >= threshold where frac(u) is in [a, 1/2 - a], with
+ * u = time_phase + space / space_wavelength and space monotonic in i,
+ * so the lit LEDs can be found without evaluating every one.
+ */
+static void find_lit(struct launch *this, struct dirty *lit)
+{
+	const float n = this->num_leds;
+	const float a = asinf(threshold) / (2 * M_PI);
+	const float u_min = this->time_phase;
+	const float u_max = this->time_phase + n / space_wavelength;
+	for (int k = floorf(u_min) - 1; k <= ceilf(u_max); ++k) {
+		float lo = fmaxf(0, (k + a - this->time_phase) * space_wavelength);
+		float hi = fminf(n, (k + 0.5f - a - this->time_phase) * space_wavelength);
+		if (lo >= hi) {
+			continue;
+		}
+		/* Invert space = (i / n)^0.1 . n, with a margin for rounding */
+		float begin = n * powf(lo / n, 10) - 1;
+		float end = n * powf(hi / n, 10) + 2;
+		dirty_add(lit, begin < 0 ? 0 : begin, end > n ? n : end);
+	}
+}
+
 void launch_run(struct launch *this)
 {
 	float dt = timing_step(&this->timing);
 	step_phase(&this->time_phase, dt, time_wavelength);
-	for (size_t i = 0; i < this->num_leds; ++i) {
-		struct led *led = this->leds + i;
-		float space = powf(i * 1.0f / this->num_leds, 0.1f) * this->num_leds;
-		float arg = sinf(2 * M_PI * (this->time_phase + space / space_wavelength));
-		arg = arg < threshold ? 0 : powf((arg - threshold) / (1 - threshold), 8);
-		led->brightness = 1;
-		struct hsv hsv = {
-			.h = 0.6,
-			.s = 1 - powf(arg, 4),
-			.v = arg
-		};
-		hsv2rgb(&hsv, &led->colour);
+	/* Clear what was lit, render what is lit now */
+	this->dirty = this->lit;
+	dirty_clear(&this->lit);
+	find_lit(this, &this->lit);
+	dirty_merge(&this->dirty, &this->lit);
+	if (this->indexed) {
+		FOREACH_DIRTY_SPAN(&this->dirty, span) {
+			memset(this->indexed->intensity + span->begin, 0, span->end - span->begin);
+		}
+		FOREACH_DIRTY_SPAN(&this->lit, span) {
+			wavetable_render_indexed(this->wave, this->time_phase, span->begin, span->end, this->indexed);
+		}
+		return;
+	}
+	FOREACH_DIRTY_SPAN(&this->dirty, span) {
+		for (struct led *it = this->leds + span->begin, *end = this->leds + span->end; it != end; ++it) {
+			it->brightness = 1;
+			it->colour = black;
+		}
+	}
+	FOREACH_DIRTY_SPAN(&this->lit, span) {
+		wavetable_render(this->wave, this->time_phase, span->begin, span->end);
+	}
+}
+
+/* Render palette indices instead, the wave table is the palette */
+int launch_set_indexed(struct launch *this, struct indexed *indexed)
+{
+	this->palette = wavetable_palette(this->wave);
+	if (!this->palette) {
+		return -1;
+	}
+	if (indexed_set_palette(indexed, this->palette) != 0) {
+		return -1;
 	}
+	this->indexed = indexed;
+	/* Clear the whole strip again, in the new framebuffer */
+	dirty_all(&this->lit, this->num_leds);
+	return 0;
 }
 
 void launch_free(struct launch *this)
@@ -60,5 +138,7 @@ void launch_free(struct launch *this)
 	if (!this) {
 		return;
 	}
+	wavetable_free(this->wave);
+	palette_free(this->palette);
 	free(this);
 }
@@ -2,6 +2,8 @@
 
 #include "led.h"
 #include "timing.h"
+#include "dirty.h"
+#include "wavetable.h"
 
 struct launch
 {
@@ -9,8 +11,16 @@ struct launch
 	struct led *leds;
 	struct timing timing;
 	float time_phase;
+	struct wavetable *wave;
+	/* Optional, rendered into instead of leds */
+	struct indexed *indexed;
+	struct palette *palette;
+	/* LEDs above threshold last frame, and union with those lit now */
+	struct dirty lit;
+	struct dirty dirty;
 };
 
 struct launch *launch_init(size_t num_leds, struct led *leds);
 void launch_run(struct launch *this);
+int launch_set_indexed(struct launch *this, struct indexed *indexed);
 void launch_free(struct launch *this);
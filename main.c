@@ -3,42 +3,83 @@
 #include <stdbool.h>
 #include <string.h>
 
+#include <time.h>
 #include <unistd.h>
 #include <signal.h>
 #include <getopt.h>
 
+#include "timing.h"
 #include "sk9822.h"
-#include "rainbow_pulse.h"
-#include "launch.h"
-#include "particles.h"
+#include "ws2812.h"
+#include "animation.h"
+#include "zone.h"
 #include "mirror.h"
+#include "audio.h"
+#include "interp.h"
+#include "quality.h"
+#include "calibration.h"
+#include "latency.h"
+#include "power.h"
+#include "trace.h"
 
 static volatile int quitting = 0;
 
+static double monotonic(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static volatile int recolour = 0;
+
 static void exit_signal_handler(int signo)
 {
 	(void) signo;
 	quitting = 1;
 }
 
-enum animation
+static void recolour_signal_handler(int signo)
+{
+	(void) signo;
+	recolour = 1;
+}
+
+/* Brightness is applied once, to LEDs as they are rendered */
+struct dimmer
 {
-	RAINBOW_PULSE = 0,
-	LAUNCH = 1,
-	PARTICLES = 2,
+	struct led *leds;
+	struct indexed *indexed;
+	float brightness;
 };
 
+static void dim(void *context, size_t begin, size_t end)
+{
+	const struct dimmer *this = context;
+	if (this->indexed) {
+		for (uint8_t *it = this->indexed->intensity + begin, *out = this->indexed->intensity + end; it != out; ++it) {
+			*it *= this->brightness;
+		}
+	} else {
+		for (struct led *led = this->leds + begin, *out = this->leds + end; led != out; ++led) {
+			led->brightness *= this->brightness;
+		}
+	}
+}
+
 enum protocol
 {
 	APA102 = 0,
-	SK9822 = 1
+	SK9822 = 1,
+	WS2812 = 2,
+	SK6812 = 3
 };
 
 int main(int argc, char *argv[])
 {
 	int ret = 1;
 
-	enum animation animation_to_run = RAINBOW_PULSE;
+	enum animation_type animation_to_run = RAINBOW_PULSE;
 	enum protocol protocol = APA102;
 	const char *device = "/dev/spidev0.0";
 	int device_speed = 1000000;
@@ -46,10 +87,24 @@ int main(int argc, char *argv[])
 	int time_step_us = 10000;
 	bool mirror = false;
 	float brightness = 1;
+	enum timing_source clock_source = TIMING_REALTIME;
+	double virtual_step = 0;
+	long num_frames = -1;
+	const char *audio_path = NULL;
+	int sim_divider = 1;
+	int first_universe = 1;
+	bool auto_quality = false;
+	bool indexed_mode = false;
+	const char *calibration_path = NULL;
+	bool measure_latency = false;
+	double power_budget = 0;
+	struct zone zones[ZONES_MAX];
+	int num_zones = 0;
+	const char *formula = "hsv(i / n + t / 10, 1, 0.5 + 0.5 * sin(i / 8 - t * 4))";
 
 	/* Parse arguments */
 	int opt;
-	while ((opt = getopt(argc, argv, "hd:s:l:a:p:t:mb:")) != -1) {
+	while ((opt = getopt(argc, argv, "hd:s:l:a:p:t:mb:v:n:r:e:A:i:u:qxc:Lw:z:")) != -1) {
 		switch (opt) {
 		case 'd':
 			device = optarg;
@@ -61,21 +116,20 @@ int main(int argc, char *argv[])
 			real_num_leds = atoi(optarg);
 			break;
 		case 'a':
-			if (strcasecmp(optarg, "rainbow_pulse") == 0) {
-				animation_to_run = RAINBOW_PULSE;
-			} else if (strcasecmp(optarg, "launch") == 0) {
-				animation_to_run = LAUNCH;
-			} else if (strcasecmp(optarg, "particles") == 0) {
-				animation_to_run = PARTICLES;
-			} else {
+			if (animation_parse(optarg) < 0) {
 				goto invalid_arg;
 			}
+			animation_to_run = animation_parse(optarg);
 			break;
 		case 'p':
 			if (strcasecmp(optarg, "apa102") == 0) {
 				protocol = APA102;
 			} else if (strcasecmp(optarg, "sk9822") == 0) {
 				protocol = SK9822;
+			} else if (strcasecmp(optarg, "ws2812") == 0) {
+				protocol = WS2812;
+			} else if (strcasecmp(optarg, "sk6812") == 0) {
+				protocol = SK6812;
 			} else {
 				goto invalid_arg;
 			}
@@ -89,6 +143,52 @@ int main(int argc, char *argv[])
 		case 'b':
 			brightness = atof(optarg);
 			break;
+		case 'v':
+			clock_source = TIMING_VIRTUAL;
+			virtual_step = atof(optarg) * 1e-3;
+			break;
+		case 'n':
+			num_frames = atol(optarg);
+			break;
+		case 'r':
+			srand(atoi(optarg));
+			break;
+		case 'e':
+			formula = optarg;
+			break;
+		case 'A':
+			audio_path = optarg;
+			break;
+		case 'i':
+			sim_divider = atoi(optarg);
+			if (sim_divider < 1) {
+				goto invalid_arg;
+			}
+			break;
+		case 'u':
+			first_universe = atoi(optarg);
+			break;
+		case 'q':
+			auto_quality = true;
+			break;
+		case 'x':
+			indexed_mode = true;
+			break;
+		case 'c':
+			calibration_path = optarg;
+			break;
+		case 'L':
+			measure_latency = true;
+			break;
+		case 'w':
+			power_budget = atof(optarg);
+			break;
+		case 'z':
+			if (num_zones == ZONES_MAX || zone_parse(&zones[num_zones], optarg) != 0) {
+				goto invalid_arg;
+			}
+			num_zones++;
+			break;
 		case '?':
 		default:
 invalid_arg:
@@ -98,13 +198,26 @@ invalid_arg:
 help:
 			fprintf(stderr, "Syntax: %s"
 					"\n\t [ -d device ]"
-					"\n\t [ -s device_speed ]"
+					"\n\t [ -s device_speed ]  <--apa102/sk9822 only"
 					"\n\t [ -l effective_num_leds ]"
-					"\n\t [ -a { rainbow_pulse | launch | particles } ]"
-					"\n\t [ -p { apa102 | sk9822 } ]"
+					"\n\t [ -a { rainbow_pulse | launch | particles | formula | sacn } ]"
+					"\n\t [ -p { apa102 | sk9822 | ws2812 | sk6812 } ]  <--sk6812 is RGBW"
 					"\n\t [ -t time_step_ms ]"
 					"\n\t [ -m ]  <--mirror"
 					"\n\t [ -b brightness ]"
+					"\n\t [ -v virtual_time_step_ms ]  <--render faster than real-time"
+					"\n\t [ -n num_frames ]"
+					"\n\t [ -r random_seed ]"
+					"\n\t [ -e expression ]  <--for formula, over (i, t, n)"
+					"\n\t [ -A { audio.wav | - } ]  <--audio-reactive rainbow_pulse/particles"
+					"\n\t [ -i sim_divider ]  <--simulate every Nth frame, interpolate between"
+					"\n\t [ -u first_universe ]  <--for sacn, E1.31 or Art-Net"
+					"\n\t [ -q ]  <--lower quality automatically to meet time_step_ms"
+					"\n\t [ -x ]  <--palette-indexed framebuffer for launch/particles, SIGUSR1 recolours"
+					"\n\t [ -c calibration_file ]  <--per-strip colour matrix and gamma"
+					"\n\t [ -L ]  <--report input-to-photon latency per frame source"
+					"\n\t [ -w power_budget_mA ]  <--dim frames estimated to draw more"
+					"\n\t [ -z start:count:animation:period_ms ]...  <--zones instead of -a, each at its own rate"
 					"\n", argv[0]);
 			goto fail_args;
 		}
@@ -118,16 +231,52 @@ help:
 		perror("signal");
 	}
 
+	if (signal(SIGUSR1, recolour_signal_handler) == SIG_ERR) {
+		perror("signal");
+	}
+
+	if (timing_clock_init(clock_source, virtual_step) != 0) {
+		perror("timing_clock_init");
+		goto fail_args;
+	}
+	const bool realtime = clock_source == TIMING_REALTIME;
+
 	int effective_num_leds = real_num_leds;
 	if (mirror) {
 		effective_num_leds /= 2;
 	}
 
+	/* Without zones, one animation covers the strip on every frame */
+	const bool zoned = num_zones > 0;
+	if (!zoned) {
+		zones[num_zones++] = (struct zone) { .begin = 0, .num_leds = effective_num_leds, .type = animation_to_run };
+	}
+	bool takes_audio = false;
+	for (int z = 0; z < num_zones; ++z) {
+		if (zones[z].begin + zones[z].num_leds > (size_t) effective_num_leds) {
+			fprintf(stderr, "Zone at %zu runs past LED %d\n", zones[z].begin, effective_num_leds - 1);
+			goto fail_args;
+		}
+		for (int other = 0; other < z; ++other) {
+			if (zones[z].begin < zones[other].begin + zones[other].num_leds &&
+					zones[other].begin < zones[z].begin + zones[z].num_leds) {
+				fprintf(stderr, "Zones at %zu and %zu overlap\n", zones[other].begin, zones[z].begin);
+				goto fail_args;
+			}
+		}
+		takes_audio |= animation_takes_audio(zones[z].type);
+	}
+	if (zoned && (sim_divider > 1 || auto_quality || indexed_mode)) {
+		fprintf(stderr, "Zones can't be interpolated or indexed\n");
+		goto fail_args;
+	}
+
 	/* Create LED driver */
 	void *led_state;
 	int (*led_update)(void *);
 	void (*led_free)(void *);
 	struct led *leds;
+	struct dirty *led_dirty;
 	if (protocol == APA102 || protocol == SK9822) {
 		led_update = (void *) sk9822_update;
 		led_free = (void *) sk9822_free;
@@ -137,78 +286,286 @@ help:
 			goto fail_led;
 		}
 		leds = ((struct sk9822 *) led_state)->leds;
+		led_dirty = &((struct sk9822 *) led_state)->dirty;
+	} else if (protocol == WS2812 || protocol == SK6812) {
+		led_update = (void *) ws2812_update;
+		led_free = (void *) ws2812_free;
+		led_state = ws2812_init(device, real_num_leds, protocol == SK6812);
+		if (!led_state) {
+			perror("ws2812_init");
+			goto fail_led;
+		}
+		leds = ((struct ws2812 *) led_state)->leds;
+		led_dirty = &((struct ws2812 *) led_state)->dirty;
 	} else {
 		perror("Unknown protocol");
 		goto fail_led;
 	}
 
-	/* Create animation engine */
-	void *animation_state;
-	int (*animation_update)(void *);
-	void (*animation_free)(void *);
-	if (animation_to_run == RAINBOW_PULSE) {
-		animation_update = (void *) rainbow_pulse_run;
-		animation_free = (void *) rainbow_pulse_free;
-		animation_state = rainbow_pulse_init(effective_num_leds, leds);
-		if (!animation_state) {
-			perror("rainbow_pulse_init");
-			goto fail_animation;
-		}
-	} else if (animation_to_run == LAUNCH) {
-		animation_update = (void *) launch_run;
-		animation_free = (void *) launch_free;
-		animation_state = launch_init(effective_num_leds, leds);
-		if (!animation_state) {
-			perror("launch_init");
-			goto fail_animation;
-		}
-	} else if (animation_to_run == PARTICLES) {
-		animation_update = (void *) particles_run;
-		animation_free = (void *) particles_free;
-		animation_state = particles_init(effective_num_leds, leds,
-				8, /* #particles */
-				30, 50, /* velocity */
-				1, 5); /* size */
-		if (!animation_state) {
-			perror("particles_init");
-			goto fail_animation;
+	/* Load colour calibration, which the driver applies while encoding */
+	struct calibration *calibration = NULL;
+	if (calibration_path) {
+		calibration = calibration_load(calibration_path);
+		if (!calibration) {
+			perror("calibration_load");
+			goto fail_calibration;
+		}
+		if (protocol == APA102 || protocol == SK9822) {
+			((struct sk9822 *) led_state)->calibration = calibration;
+		} else {
+			((struct ws2812 *) led_state)->calibration = calibration;
+		}
+	}
+
+	/* Create power limiter, which the driver feeds while encoding */
+	struct power *power = NULL;
+	if (power_budget > 0) {
+		const bool sk9822 = protocol == APA102 || protocol == SK9822;
+		power = power_init(real_num_leds, power_budget, sk9822 ? SK9822_POWER_UNIT : WS2812_POWER_UNIT);
+		if (!power) {
+			perror("power_init");
+			goto fail_power;
+		}
+		if (sk9822) {
+			((struct sk9822 *) led_state)->power = power;
+		} else {
+			((struct ws2812 *) led_state)->power = power;
+		}
+	}
+
+	/* Create indexed framebuffer, which the driver then encodes instead */
+	struct indexed *indexed = NULL;
+	if (indexed_mode) {
+		if (sim_divider > 1 || auto_quality) {
+			fprintf(stderr, "Indexed framebuffer can't be interpolated\n");
+			goto fail_indexed;
+		}
+		indexed = indexed_init(real_num_leds);
+		if (!indexed) {
+			perror("indexed_init");
+			goto fail_indexed;
+		}
+		if (protocol == APA102 || protocol == SK9822) {
+			((struct sk9822 *) led_state)->indexed = indexed;
+		} else {
+			((struct ws2812 *) led_state)->indexed = indexed;
+		}
+	}
+
+	/* Open audio input */
+	struct audio *audio = NULL;
+	if (audio_path) {
+		if (!takes_audio) {
+			fprintf(stderr, "Audio input requires rainbow_pulse or particles\n");
+			goto fail_audio;
+		}
+		audio = audio_init(audio_path);
+		if (!audio) {
+			perror("audio_init");
+			goto fail_audio;
+		}
+	}
+
+	/* Create latency recorder, fed each frame's origin once it is written */
+	struct latency *latency = NULL;
+	if (measure_latency) {
+		latency = latency_init();
+		if (!latency) {
+			perror("latency_init");
+			goto fail_latency;
+		}
+	}
+
+	/* Create quality controller, against the frame period */
+	struct quality *quality = NULL;
+	if (auto_quality) {
+		quality = quality_init(time_step_us * 1e-6);
+		if (!quality) {
+			perror("quality_init");
+			goto fail_quality;
+		}
+	}
+
+	/* Create interpolator, the animation then renders into its buffer */
+	struct interp *interp = NULL;
+	struct led *render_leds = leds;
+	if (sim_divider > 1 || quality) {
+		interp = interp_init(effective_num_leds, sim_divider);
+		if (!interp) {
+			perror("interp_init");
+			goto fail_interp;
+		}
+		render_leds = interp->next;
+	}
+
+	/* Create an animation engine for each zone */
+	const struct animation_inputs inputs = {
+		.formula = formula,
+		.first_universe = first_universe,
+		.audio = audio,
+		.latency = latency,
+	};
+	for (int z = 0; z < num_zones; ++z) {
+		zones[z].animation = animation_init(zones[z].type, zones[z].num_leds, render_leds + zones[z].begin, &inputs);
+		if (!zones[z].animation) {
+			perror("animation_init");
+			goto fail_run;
+		}
+	}
+	struct animation *animation = zones[0].animation;
+
+	if (indexed) {
+		if (!animation->indexed) {
+			fprintf(stderr, "Indexed framebuffer requires launch or particles\n");
+			goto fail_run;
+		}
+		if (animation->indexed(animation->state, indexed) != 0) {
+			perror("animation_indexed");
+			goto fail_run;
 		}
-	} else {
-		perror("Unknown animation");
-		goto fail_animation;
 	}
 
 	/* Main loop */
-	while (!quitting) {
-		animation_update(animation_state);
-		if (mirror) {
-			mirror_leds(real_num_leds, leds);
+	struct timespec wall_start;
+	struct timespec wall_end;
+	clock_gettime(CLOCK_MONOTONIC, &wall_start);
+	double deadline = monotonic();
+	struct dimmer dimmer = { .leds = leds, .indexed = indexed, .brightness = brightness };
+	long frame = 0;
+	for (; !quitting && frame != num_frames; ++frame) {
+		const double frame_start = monotonic();
+		TRACE1(frame_start, frame);
+		if (timing_tick() != 0) {
+			perror("timing_tick");
+			goto fail_run;
+		}
+		if (audio && audio_update(audio) != 0) {
+			perror("audio_update");
+			goto fail_run;
+		}
+		struct dirty frame_dirty;
+		/* Clock-driven frames are stamped at frame start, or by the audio they react to */
+		struct frame_origin clock_origin = { .source = LATENCY_CLOCK, .time = frame_start };
+		if (audio && audio->unconsumed) {
+			clock_origin.source = LATENCY_AUDIO;
+			clock_origin.time = audio->block_arrival.tv_sec + audio->block_arrival.tv_nsec * 1e-9;
+		}
+		/* Stamp follows the frame through brightness, mirror and encode */
+		struct frame_origin origin = { .source = LATENCY_CLOCK, .time = 0 };
+		TRACE0(render_start);
+		const double render_start = monotonic();
+		if (interp) {
+			interp_run(interp, animation->update, animation->state, leds);
+			dirty_all(&frame_dirty, effective_num_leds);
+			origin = animation->origin ? *animation->origin : clock_origin;
+		} else {
+			dirty_clear(&frame_dirty);
+			zones_run(zones, num_zones, timing_now(), &clock_origin, &frame_dirty, &origin, dim, &dimmer);
+		}
+		const double render_time = monotonic() - render_start;
+		TRACE0(render_end);
+		if (indexed && recolour) {
+			recolour = 0;
+			palette_rotate(indexed->palette);
+		}
+		/* Zones dimmed what they redrew, the interpolator rewrites every LED */
+		if (interp) {
+			dim(&dimmer, 0, effective_num_leds);
 		}
-		for (struct led *led = leds, *out = leds + real_num_leds; led != out; ++led) {
-			led->brightness *= brightness;
+		if (mirror && indexed) {
+			indexed_mirror(indexed, real_num_leds, &frame_dirty);
+		} else if (mirror) {
+			mirror_leds(real_num_leds, leds, &frame_dirty);
 		}
+		dirty_merge(led_dirty, &frame_dirty);
 		if (led_update(led_state) != 0) {
 			perror("led_update");
 			goto fail_run;
 		}
-		usleep(time_step_us);
+		const double frame_end = monotonic();
+		if (origin.time) {
+			TRACE2(frame_latency, origin.source, (long) ((frame_end - origin.time) * 1e9));
+			latency_record(latency, &origin, frame_end);
+		}
+		if (audio) {
+			audio_frame_done(audio);
+		}
+		TRACE2(frame_end, frame, (long) ((frame_end - frame_start) * 1e9));
+		/* Only the render responds to the quality level, not the blocking write */
+		if (quality && quality_update(quality, render_time)) {
+			for (int z = 0; z < num_zones; ++z) {
+				if (zones[z].animation->quality) {
+					zones[z].animation->quality(zones[z].animation->state, quality->level);
+				}
+			}
+			interp_set_divider(interp, sim_divider * quality_sim_factor(quality->level));
+		}
+		if (realtime) {
+			/* Sleep until the next frame is due, or start it now if late */
+			deadline += time_step_us * 1e-6;
+			if (deadline > frame_end) {
+				usleep((deadline - frame_end) * 1e6);
+			} else {
+				TRACE2(deadline_miss, frame, (long) ((frame_end - deadline) * 1e9));
+				deadline = frame_end;
+			}
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &wall_end);
+	if (!realtime) {
+		double wall = (wall_end.tv_sec - wall_start.tv_sec) +
+			(wall_end.tv_nsec - wall_start.tv_nsec) * 1e-9;
+		fprintf(stderr, "Rendered %ld frames (%.3fs virtual) in %.3fs: %.1f fps\n",
+				frame, timing_now(), wall, frame / wall);
+	}
+	if (audio) {
+		audio_report(audio);
+	}
+	if (interp) {
+		interp_report(interp);
+	}
+	for (int z = 0; z < num_zones; ++z) {
+		animation_report(zones[z].animation);
+	}
+	if (zoned) {
+		zones_report(zones, num_zones, frame);
+	}
+	if (quality) {
+		quality_report(quality);
+	}
+	if (latency) {
+		latency_report(latency);
+	}
+	if (power) {
+		power_report(power);
 	}
 
 	/* Clear LEDs */
 	fprintf(stderr, "Clearing LEDs\n");
 	for (int it = 0; it < 25; ++it) {
 		for (int i = 0; i < real_num_leds; ++i) {
-			leds[i].brightness *= 0.7;
+			if (indexed) {
+				indexed->intensity[i] *= 0.7;
+			} else {
+				leds[i].brightness *= 0.7;
+			}
 		}
+		dirty_all(led_dirty, real_num_leds);
 		if (led_update(led_state) != 0) {
 			perror("led_update");
 			goto fail_run;
 		}
-		usleep(time_step_us);
+		if (realtime) {
+			usleep(time_step_us);
+		}
 	}
 	for (int i = 0; i < real_num_leds; ++i) {
 		leds[i] = LED_INIT;
+		if (indexed) {
+			indexed->intensity[i] = 0;
+		}
 	}
+	dirty_all(led_dirty, real_num_leds);
 	if (led_update(led_state) != 0) {
 		perror("led_update");
 		goto fail_run;
@@ -218,8 +575,23 @@ help:
 
 	/* Clean up */
 fail_run:
-	animation_free(animation_state);
-fail_animation:
+	for (int z = 0; z < num_zones; ++z) {
+		animation_free(zones[z].animation);
+	}
+	interp_free(interp);
+fail_interp:
+	quality_free(quality);
+fail_quality:
+	latency_free(latency);
+fail_latency:
+	audio_free(audio);
+fail_audio:
+	indexed_free(indexed);
+fail_indexed:
+	power_free(power);
+fail_power:
+	calibration_free(calibration);
+fail_calibration:
 	led_free(led_state);
 fail_led:
 fail_args:
@@ -1,12 +1,18 @@
 #include "mirror.h"
 
-void mirror_leds(int num_leds, struct led *leds)
+/* Mirrors the dirty spans of the first half, and marks their reflections dirty */
+void mirror_leds(int num_leds, struct led *leds, struct dirty *dirty)
 {
-	struct led *out = leds + num_leds - 1;
-	struct led *in = leds;
-	while (in < out) {
-		*out = *in;
-		++in;
-		--out;
+	const struct dirty half = *dirty;
+	FOREACH_DIRTY_SPAN(&half, span) {
+		struct led *out = leds + num_leds - 1 - span->begin;
+		struct led *in = leds + span->begin;
+		struct led *end = leds + span->end;
+		while (in < out && in < end) {
+			*out = *in;
+			++in;
+			--out;
+		}
+		dirty_add(dirty, num_leds - span->end, num_leds - span->begin);
 	}
 }
@@ -1,4 +1,5 @@
 #pragma once
 #include "led.h"
+#include "dirty.h"
 
-void mirror_leds(int num_leds, struct led *leds);
+void mirror_leds(int num_leds, struct led *leds, struct dirty *dirty);
@@ -0,0 +1,142 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "palette.h"
+
+static int quantise(float value)
+{
+	return !(value > 0) ? 0 : value > 1 ? 255 : (int) roundf(value * 255);
+}
+
+struct palette *palette_init(int size)
+{
+	struct palette *this = malloc(sizeof(*this));
+	if (!this) {
+		perror("malloc");
+		goto fail;
+	}
+	memset(this, 0, sizeof(*this));
+	if (size < 1 || size > PALETTE_MAX_SIZE) {
+		fprintf(stderr, "Palette of %d colours, at most %d supported\n", size, PALETTE_MAX_SIZE);
+		goto fail;
+	}
+	this->size = size;
+	this->colours = calloc(size, sizeof(*this->colours));
+	this->bytes = calloc(size, sizeof(*this->bytes));
+	if (!this->colours || !this->bytes) {
+		perror("calloc");
+		goto fail;
+	}
+	return this;
+fail:
+	palette_free(this);
+	return NULL;
+}
+
+void palette_set(struct palette *this, int index, const struct rgb *colour)
+{
+	this->colours[index] = *colour;
+	this->bytes[index][0] = quantise(colour->r);
+	this->bytes[index][1] = quantise(colour->g);
+	this->bytes[index][2] = quantise(colour->b);
+}
+
+/* Call once a batch of palette_set is done, the new colours show next frame */
+void palette_commit(struct palette *this)
+{
+	this->generation++;
+}
+
+/* Recolours everything using the palette: red to green, green to blue, blue to red */
+void palette_rotate(struct palette *this)
+{
+	for (int i = 0; i < this->size; ++i) {
+		const struct rgb *c = &this->colours[i];
+		struct rgb rotated = { .r = c->b, .g = c->r, .b = c->g };
+		palette_set(this, i, &rotated);
+	}
+	palette_commit(this);
+}
+
+void palette_free(struct palette *this)
+{
+	if (!this) {
+		return;
+	}
+	free(this->colours);
+	free(this->bytes);
+	free(this);
+}
+
+struct indexed *indexed_init(size_t num_leds)
+{
+	struct indexed *this = malloc(sizeof(*this));
+	if (!this) {
+		perror("malloc");
+		goto fail;
+	}
+	memset(this, 0, sizeof(*this));
+	this->num_leds = num_leds;
+	this->intensity = calloc(num_leds, sizeof(*this->intensity));
+	this->index8 = calloc(num_leds, sizeof(*this->index8));
+	if (!this->intensity || !this->index8) {
+		perror("calloc");
+		goto fail;
+	}
+	return this;
+fail:
+	indexed_free(this);
+	return NULL;
+}
+
+/* Index plane widens or narrows to suit the palette, indices restart at 0 */
+int indexed_set_palette(struct indexed *this, struct palette *palette)
+{
+	const int wide = palette->size > 256;
+	if (wide && !this->index16) {
+		this->index16 = calloc(this->num_leds, sizeof(*this->index16));
+		if (!this->index16) {
+			perror("calloc");
+			return -1;
+		}
+		free(this->index8);
+		this->index8 = NULL;
+	} else if (!wide && !this->index8) {
+		this->index8 = calloc(this->num_leds, sizeof(*this->index8));
+		if (!this->index8) {
+			perror("calloc");
+			return -1;
+		}
+		free(this->index16);
+		this->index16 = NULL;
+	}
+	this->wide = wide;
+	this->palette = palette;
+	return 0;
+}
+
+/* As mirror_leds */
+void indexed_mirror(struct indexed *this, int num_leds, struct dirty *dirty)
+{
+	const struct dirty half = *dirty;
+	FOREACH_DIRTY_SPAN(&half, span) {
+		size_t out = num_leds - 1 - span->begin;
+		for (size_t in = span->begin; in < out && in < span->end; ++in, --out) {
+			indexed_set(this, out, indexed_get(this, in), this->intensity[in]);
+		}
+		dirty_add(dirty, num_leds - span->end, num_leds - span->begin);
+	}
+}
+
+void indexed_free(struct indexed *this)
+{
+	if (!this) {
+		return;
+	}
+	free(this->index8);
+	free(this->index16);
+	free(this->intensity);
+	free(this);
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include "colour.h"
+#include "dirty.h"
+
+#define PALETTE_MAX_SIZE 65536
+
+/* Colours referenced by index from an indexed framebuffer */
+struct palette
+{
+	int size;
+	struct rgb *colours;
+	/* Quantised r, g, b, which the encoders expand to wire bytes */
+	uint8_t (*bytes)[3];
+	/* Bumped on every commit, encoders then re-expand the whole strip */
+	unsigned generation;
+};
+
+struct palette *palette_init(int size);
+void palette_set(struct palette *this, int index, const struct rgb *colour);
+void palette_commit(struct palette *this);
+void palette_rotate(struct palette *this);
+void palette_free(struct palette *this);
+
+/*
+ * Framebuffer of a palette index and an intensity per LED, in separate
+ * planes: 2 or 3 bytes per LED instead of a float brightness and colour.
+ * Indices are 16-bit when the palette has more than 256 colours.
+ */
+struct indexed
+{
+	size_t num_leds;
+	int wide;
+	uint8_t *index8;
+	uint16_t *index16;
+	/* 0..255, black at 0 whatever the index */
+	uint8_t *intensity;
+	struct palette *palette;
+};
+
+struct indexed *indexed_init(size_t num_leds);
+int indexed_set_palette(struct indexed *this, struct palette *palette);
+void indexed_mirror(struct indexed *this, int num_leds, struct dirty *dirty);
+void indexed_free(struct indexed *this);
+
+static inline int indexed_get(const struct indexed *this, size_t i)
+{
+	return this->wide ? this->index16[i] : this->index8[i];
+}
+
+static inline void indexed_set(struct indexed *this, size_t i, int index, int intensity)
+{
+	if (this->wide) {
+		this->index16[i] = index;
+	} else {
+		this->index8[i] = index;
+	}
+	this->intensity[i] = intensity;
+}
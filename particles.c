@@ -6,9 +6,24 @@
 #include "particles.h"
 #include "colour.h"
 #include "util.h"
+#include "trace.h"
 
-#define FOREACH_CONST_PARTICLE(it) for (struct particle *it = this->particles, *it##_end = it + this->num_particles; it != it##_end; ++it)
-#define FOREACH_PARTICLE(it) for (struct particle *it = this->particles, *it##_end = it + this->num_particles; it != it##_end; ++it)
+static const float kick_velocity = 60;
+static const float kick_decay = 0.5;
+
+/* Walls are identified by negative indices */
+#define WALL_LEFT -1
+#define WALL_RIGHT -2
+#define NO_PARTICLE -3
+
+static const float wall_size = 1;
+
+/* Knobs for each quality level */
+static const float quality_particles[QUALITY_LEVELS] = { 1, 1, 0.75, 0.5, 0.5 };
+static const float quality_splat_width[QUALITY_LEVELS] = { 1, 0.75, 0.75, 0.5, 0.5 };
+
+/* Partial sums for reductions, so they vectorise without reassociating */
+#define LANES 8
 
 static float rand_range(float min, float max)
 {
@@ -17,11 +32,24 @@ static float rand_range(float min, float max)
 	return interp2f(min, max, r, 0, rm);
 }
 
-static float calc_energy(const struct particles *this)
+float particles_calc_energy(const struct particles *this)
 {
+	const float *restrict mass = this->mass;
+	const float *restrict velocity = this->velocity;
+	const int n = this->num_particles;
+	float lanes[LANES] = { 0 };
+	int i = 0;
+	for (; i + LANES <= n; i += LANES) {
+		for (int k = 0; k < LANES; ++k) {
+			lanes[k] += mass[i + k] * velocity[i + k] * velocity[i + k];
+		}
+	}
 	float result = 0;
-	FOREACH_CONST_PARTICLE(p) {
-		result += p->mass * p->velocity * p->velocity;
+	for (; i < n; ++i) {
+		result += mass[i] * velocity[i] * velocity[i];
+	}
+	for (int k = 0; k < LANES; ++k) {
+		result += lanes[k];
 	}
 	return result / 2;
 }
@@ -40,57 +68,53 @@ struct particles *particles_init(size_t num_leds, struct led *leds, int num_part
 	}
 	this->num_leds = num_leds;
 	this->leds = leds;
-	this->num_particles = num_particles + 2;
-	this->particles = malloc(sizeof(*this->particles) * this->num_particles);
-	if (!this->particles) {
+	this->num_particles = num_particles;
+	this->max_particles = num_particles;
+	this->splat_width = 1;
+	this->position = malloc(sizeof(*this->position) * num_particles);
+	this->velocity = malloc(sizeof(*this->velocity) * num_particles);
+	this->mass = malloc(sizeof(*this->mass) * num_particles);
+	this->size = malloc(sizeof(*this->size) * num_particles);
+	this->colour = malloc(sizeof(*this->colour) * num_particles);
+	if (!this->position || !this->velocity || !this->mass || !this->size || !this->colour) {
 		perror("malloc");
 		goto fail;
 	}
-	/* Initialise particles (excluding walls at end) */
-	for (int i = 1; i < this->num_particles - 1; ++i) {
-		struct particle *p = &this->particles[i];
-		p->size = rand_range(min_size, max_size);
-		p->mass = p->size;
-		p->position = interp2f(1, this->num_leds - 2, i, 0, this->num_particles - 1);
-		p->velocity = rand_range(min_velocity, max_velocity) * (rand_range(0, 2) < 1 ? -1 : +1);
+	/* Spread evenly between the walls, which count as the first and last slots */
+	const int slots = num_particles + 2;
+	for (int j = 0; j < num_particles; ++j) {
+		const int i = j + 1;
+		this->size[j] = rand_range(min_size, max_size);
+		this->mass[j] = this->size[j];
+		this->position[j] = interp2f(1, this->num_leds - 2, i, 0, slots - 1);
+		this->velocity[j] = rand_range(min_velocity, max_velocity) * (rand_range(0, 2) < 1 ? -1 : +1);
 		struct hsv hsv = {
-			.h = interp2f(0, 1, i, 1, this->num_particles - 1), // -1 instead of -2, we don't want to end on same colour as start
+			.h = interp2f(0, 1, i, 1, slots - 1), // -1 instead of -2, we don't want to end on same colour as start
 			.s = 1,
 			.v = 1
 		};
-		hsv2rgb(&hsv, &p->colour);
-		p->immobile = 0;
-	}
-	/* Left wall */
-	{
-		struct particle *p = &this->particles[0];
-		p->size = 1;
-		p->mass = 1e9;
-		p->position = 0;
-		p->velocity = 0;
-		p->colour = white;
-		p->immobile = 1;
-	}
-	/* Right wall */
-	{
-		struct particle *p = &this->particles[this->num_particles - 1];
-		p->size = 1;
-		p->mass = 1e9;
-		p->position = this->num_leds - 1;
-		p->velocity = 0;
-		p->colour = white;
-		p->immobile = 1;
-	}
-	this->total_energy = calc_energy(this);
+		hsv2rgb(&hsv, &this->colour[j]);
+	}
+	this->total_energy = particles_calc_energy(this);
+	/* First frame clears the whole strip */
+	dirty_all(&this->drawn, num_leds);
+	this->base_energy = this->total_energy;
 	return this;
 fail:
 	particles_free(this);
 	return NULL;
 }
 
+static float wall_position(const struct particles *this, int wall)
+{
+	return wall == WALL_LEFT ? 0 : this->num_leds - 1;
+}
+
+/* Velocity of mobile particle p after colliding with q */
 static float collision_post_velocity(
-		const struct particle *p,
-		const struct particle *q)
+		const struct particles *this,
+		int p,
+		int q)
 {
 	/*
 	 * Conserve momentum and also energy
@@ -100,160 +124,224 @@ static float collision_post_velocity(
 	 * v1 = [(m1 - m2)u1 + 2.m2.u2] / (m1 + m2)
 	 * v2 = [(m2 - m1)u2 + 2.m1.u1] / (m1 + m2)
 	 */
-	const float m1 = p->mass;
-	const float m2 = q->mass;
-	const float u1 = p->velocity;
-	const float u2 = q->velocity;
-	if (p->immobile) {
-		return u1;
-	} else if (q->immobile) {
-		return 2 * u2 - u1;
-	} else {
-		return ((m1 - m2) * u1 + 2 * m2 * u2) / (m1 + m2);
+	const float u1 = this->velocity[p];
+	if (q < 0) {
+		/* Immobile wall */
+		return -u1;
 	}
+	const float m1 = this->mass[p];
+	const float m2 = this->mass[q];
+	const float u2 = this->velocity[q];
+	return ((m1 - m2) * u1 + 2 * m2 * u2) / (m1 + m2);
+}
+
+static void test_collision(
+		const struct particles *this,
+		int p,
+		int q,
+		float q_position,
+		float q_size,
+		float q_velocity,
+		int *collision_particle,
+		float *collision_time)
+{
+	/*
+	 * Calculate collision time
+	 *      r_p + t.v_p = r_q + t.v_q
+	 *  .'. t = (r_q - r_p) / (v_p - v_q)
+	 */
+	const float p_position = this->position[p];
+	int sign = p_position < q_position ? 1 : -1;
+	float r1 = p_position + sign * this->size[p] / 2;
+	float r2 = q_position - sign * q_size / 2;
+	float v1 = this->velocity[p];
+	float v2 = q_velocity;
+	float t = (r2 - r1) / (v1 - v2);
+	if (isfinite(t) && t >= 0 && t <= *collision_time) {
+		*collision_particle = q;
+		*collision_time = t;
+	}
+}
+
+static int is_pair(int p, int q, int a, int b)
+{
+	return (p == a && q == b) || (p == b && q == a);
 }
 
 static void find_first_collision(
 		const struct particles *this,
-		const struct particle *p,
-		struct particle **collison_particle,
+		int p,
+		int *collision_particle,
 		float *collision_time,
-		const struct particle *prev_a,
-		const struct particle *prev_b)
+		int prev_a,
+		int prev_b)
 {
-	*collison_particle = NULL;
+	*collision_particle = NO_PARTICLE;
 	/*
-	 * Find earliest collision in time-step for particle *p
+	 * Find earliest collision in time-step for particle p
 	 * that is not the same two particles as the previous collision.
 	 * Return other particle involved and time of collision
 	 */
-	FOREACH_CONST_PARTICLE(q) {
-		if (p == q) {
-			continue;
-		}
-		if ((p == prev_a && q == prev_b) || (p == prev_b && q == prev_a)) {
+	if (!is_pair(p, WALL_LEFT, prev_a, prev_b)) {
+		test_collision(this, p, WALL_LEFT, wall_position(this, WALL_LEFT), wall_size, 0, collision_particle, collision_time);
+	}
+	for (int q = 0; q < this->num_particles; ++q) {
+		if (p == q || is_pair(p, q, prev_a, prev_b)) {
 			continue;
 		}
-		/*
-		 * Calculate collision time
-		 *      r_p + t.v_p = r_q + t.v_q
-		 *  .'. t = (r_q - r_p) / (v_p - v_q)
-		 */
-		int sign = p->position < q->position ? 1 : -1;
-		float r1 = p->position + sign * p->size / 2;
-		float r2 = q->position - sign * q->size / 2;
-		float v1 = p->velocity;
-		float v2 = q->velocity;
-		float t = (r2 - r1) / (v1 - v2);
-		if (isfinite(t) && t >= 0 && t <= *collision_time) {
-			*collison_particle = q;
-			*collision_time = t;
-		}
+		test_collision(this, p, q, this->position[q], this->size[q], this->velocity[q], collision_particle, collision_time);
+	}
+	if (!is_pair(p, WALL_RIGHT, prev_a, prev_b)) {
+		test_collision(this, p, WALL_RIGHT, wall_position(this, WALL_RIGHT), wall_size, 0, collision_particle, collision_time);
 	}
 }
 
 static void get_next_collision(
 		const struct particles *this,
-		struct particle **a,
-		struct particle **b,
+		int *a,
+		int *b,
 		float *dt,
-		const struct particle *prev_a,
-		const struct particle *prev_b)
+		int prev_a,
+		int prev_b)
 {
-	FOREACH_CONST_PARTICLE(p) {
-		if (p->immobile) {
-			continue;
-		}
+	for (int p = 0; p < this->num_particles; ++p) {
 		/* Find earliest collision during time-step */
-		struct particle *cp = NULL;
+		int cp;
 		find_first_collision(this, p, &cp, dt, prev_a, prev_b);
-		if (cp) {
+		if (cp != NO_PARTICLE) {
 			*a = p;
 			*b = cp;
 		}
 	}
 }
 
-static void propagate(struct particle *p, float dt)
-{
-	/* Propagate motion */
-	p->next_position = p->position + dt * p->velocity;
-	p->next_velocity = p->velocity;
-}
-
-/* Applies collision to the first particle (*p) */
-static void collide_one(struct particle *p, const struct particle *q)
+void particles_propagate(struct particles *this, float dt)
 {
-	/* Set post-collision velocity */
-	p->next_velocity = collision_post_velocity(p, q);
+	/* Propagate motion, velocities are unchanged until a collision */
+	float *restrict position = this->position;
+	const float *restrict velocity = this->velocity;
+	for (int i = 0, n = this->num_particles; i < n; ++i) {
+		position[i] += dt * velocity[i];
+	}
 }
 
-static void commit(struct particles *this)
+static void collide(struct particles *this, int a, int b)
 {
-	/* Apply new kinematics */
-	FOREACH_PARTICLE(p) {
-		if (p->immobile) {
-			continue;
-		}
-		p->position = p->next_position;
-		p->velocity = p->next_velocity;
+	/* Both post-collision velocities depend on both pre-collision velocities */
+	const float va = collision_post_velocity(this, a, b);
+	if (b >= 0) {
+		this->velocity[b] = collision_post_velocity(this, b, a);
 	}
+	this->velocity[a] = va;
 }
 
 void particles_physics(struct particles *this, float dt)
 {
 	/* Used to prevent rounding error causing the same collision to occur ad infinitum */
-	struct particle *prev_a = NULL;
-	struct particle *prev_b = NULL;
+	int prev_a = NO_PARTICLE;
+	int prev_b = NO_PARTICLE;
 	do {
-		struct particle *a = NULL;
-		struct particle *b = NULL;
+		int a = NO_PARTICLE;
+		int b = NO_PARTICLE;
 		float dt_partial = dt;
 		/* Get time and particles involved in next collision */
 		get_next_collision(this, &a, &b, &dt_partial, prev_a, prev_b);
 		/* Propagate all particles to time of next collision */
-		FOREACH_PARTICLE(p) {
-			propagate(p, dt_partial);
-		}
+		particles_propagate(this, dt_partial);
 		/* Apply collision physics to relevant particles */
-		if (a) {
-			collide_one(a, b);
-			collide_one(b, a);
+		if (a != NO_PARTICLE) {
+			TRACE2(collision, a, b);
+			collide(this, a, b);
 		}
-		/* Commit new kinematics */
-		commit(this);
 		/* Remove time we already propagated from remaining time */
 		dt -= dt_partial;
 		/* Store collision particles */
 		prev_a = a;
 		prev_b = b;
 		/* No collision?  We've propagated the full time-step, break */
-	} while (prev_a);
+	} while (prev_a != NO_PARTICLE);
+}
+
+static int footprint_begin(const struct particles *this, float position, float size)
+{
+	return clamp(0, this->num_leds - 1, position - size * this->splat_width);
 }
 
-static void draw_gaussian(struct particles *this, float mean, float sigma, float halfwidth, const struct rgb *colour, float alpha)
+static int footprint_end(const struct particles *this, float position, float size)
+{
+	return clamp(0, this->num_leds - 1, position + size * this->splat_width);
+}
+
+static void draw_gaussian(struct particles *this, float mean, float size, const struct rgb *colour, float alpha)
 {
 	/* Blend colour bar in using Gaussian profile for alpha over bar length */
-	for (int x = clamp(0, this->num_leds - 1, mean - halfwidth), end = clamp(0, this->num_leds - 1, mean + halfwidth); x <= end; ++x) {
+	const float sigma = size / 2;
+	for (int x = footprint_begin(this, mean, size), end = footprint_end(this, mean, size); x <= end; ++x) {
 		float arg = (x - mean) / sigma;
 		float value = expf(-1 * arg * arg);
 		rgb_add(&this->leds[x].colour, colour, alpha * value);
 	}
 }
 
+/* No blending, the brighter of overlapping particles wins each LED */
+static void draw_gaussian_indexed(struct particles *this, float mean, float size, int index)
+{
+	struct indexed *indexed = this->indexed;
+	const float sigma = size / 2;
+	for (int x = footprint_begin(this, mean, size), end = footprint_end(this, mean, size); x <= end; ++x) {
+		float arg = (x - mean) / sigma;
+		int intensity = expf(-1 * arg * arg) * 255 + 0.5f;
+		if (intensity > indexed->intensity[x]) {
+			indexed_set(indexed, x, index, intensity);
+		}
+	}
+}
+
+static void add_footprint(struct particles *this, float position, float size)
+{
+	dirty_add(&this->drawn, footprint_begin(this, position, size), footprint_end(this, position, size) + 1);
+}
+
 void particles_render(struct particles *this)
 {
-	/* Draw all particles */
-	for (struct led *it = this->leds, *end = it + this->num_leds; it != end; ++it) {
-		it->brightness = 1;
-		it->colour = black;
+	const float left = wall_position(this, WALL_LEFT);
+	const float right = wall_position(this, WALL_RIGHT);
+	/* Only the old and new footprints change */
+	this->dirty = this->drawn;
+	dirty_clear(&this->drawn);
+	add_footprint(this, left, wall_size);
+	for (int i = 0; i < this->num_particles; ++i) {
+		add_footprint(this, this->position[i], this->size[i]);
+	}
+	add_footprint(this, right, wall_size);
+	dirty_merge(&this->dirty, &this->drawn);
+	if (this->indexed) {
+		/* Particles then walls in the palette */
+		FOREACH_DIRTY_SPAN(&this->dirty, span) {
+			memset(this->indexed->intensity + span->begin, 0, span->end - span->begin);
+		}
+		draw_gaussian_indexed(this, left, wall_size, this->max_particles);
+		for (int i = 0; i < this->num_particles; ++i) {
+			draw_gaussian_indexed(this, this->position[i], this->size[i], i);
+		}
+		draw_gaussian_indexed(this, right, wall_size, this->max_particles);
+		return;
+	}
+	FOREACH_DIRTY_SPAN(&this->dirty, span) {
+		for (struct led *it = this->leds + span->begin, *end = this->leds + span->end; it != end; ++it) {
+			it->brightness = 1;
+			it->colour = black;
+		}
 	}
-	FOREACH_CONST_PARTICLE(p) {
-		draw_gaussian(this, p->position, p->size / 2, p->size, &p->colour, 1);
+	/* Draw walls and all particles */
+	draw_gaussian(this, left, wall_size, &white, 1);
+	for (int i = 0; i < this->num_particles; ++i) {
+		draw_gaussian(this, this->position[i], this->size[i], &this->colour[i], 1);
 	}
+	draw_gaussian(this, right, wall_size, &white, 1);
 }
 
-void conserve_energy(struct particles *this)
+void particles_conserve_energy(struct particles *this)
 {
 	/*
 	 * We enforce conservation of energy in order to avoid rounding errors
@@ -261,33 +349,137 @@ void conserve_energy(struct particles *this)
 	 *
 	 * This correction does not conserve momentum.
 	 */
-	/* Spread the deficit over all particles */
-	float deficit = (this->total_energy - calc_energy(this)) / this->num_particles;
-	FOREACH_PARTICLE(p) {
-		if (p->immobile) {
-			/*
-			 * We won't balance energy fully due to this, in a single call,
-			 * but since we call this for each iteration, we should tend towards conservation
-			 */
-			continue;
-		}
+	/*
+	 * Spread the deficit over all particles.  The walls still take their
+	 * share, so we won't balance energy fully in a single call, but since
+	 * we call this for each iteration, we should tend towards conservation.
+	 */
+	const float deficit = (this->total_energy - particles_calc_energy(this)) / (this->num_particles + 2);
+	const float *restrict mass = this->mass;
+	float *restrict velocity = this->velocity;
+	for (int i = 0, n = this->num_particles; i < n; ++i) {
 		/*
 		 * 1/2 m u^2 + e = 1/2 m v^2
 		 * v^2 = u^2 + 2e/m
 		 * v = sqrt(u^2 + 2e/m)
-		 * v = u sqrt(1 + 2e / [m u^2])
+		 *
+		 * A relaxing kick can leave more surplus than a slow particle
+		 * has, so it loses at most 3/4 of its speed per call rather
+		 * than taking the root of a negative.  Taking the root of v^2
+		 * rather than scaling u keeps a particle at rest finite too.
 		 */
-		p->velocity *= sqrtf(1 + 2 * deficit / (p->mass * p->velocity * p->velocity));
+		const float u2 = velocity[i] * velocity[i];
+		const float v2 = u2 + 2 * deficit / mass[i];
+		velocity[i] = copysignf(sqrtf(v2 > u2 * 0.0625f ? v2 : u2 * 0.0625f), velocity[i]);
 	}
 }
 
+static void audio_kick(struct particles *this, float dt)
+{
+	const struct audio *audio = this->audio;
+	if (audio->kicks != this->kicks_seen) {
+		this->kicks_seen = audio->kicks;
+		/* Push every particle along its direction of travel */
+		for (int i = 0; i < this->num_particles; ++i) {
+			this->velocity[i] += copysignf(kick_velocity * audio->level, this->velocity[i]);
+		}
+		this->total_energy = particles_calc_energy(this);
+	}
+	/* Relax back to the initial energy */
+	this->total_energy = this->base_energy +
+		(this->total_energy - this->base_energy) * expf(-dt / kick_decay);
+}
+
 void particles_run(struct particles *this)
 {
 	/* Propagate and render */
 	float dt = timing_step(&this->timing);
+	if (this->audio) {
+		audio_kick(this, dt);
+	}
 	particles_physics(this, dt);
 	particles_render(this);
-	conserve_energy(this);
+	particles_conserve_energy(this);
+}
+
+/*
+ * Particles never pass each other, so index order is position order and
+ * the dropped ones are the rightmost.  The active ones have since had the
+ * room they left, so put those coming back evenly into whatever gap is
+ * now between the last active particle and the right wall, or spread the
+ * whole set again if they no longer fit there.
+ */
+static void place_returning(struct particles *this, int from, int to)
+{
+	float width = 0;
+	for (int i = from; i < to; ++i) {
+		width += this->size[i];
+	}
+	const float left = from ? this->position[from - 1] + this->size[from - 1] / 2 : wall_position(this, WALL_LEFT) + wall_size / 2;
+	const float right = wall_position(this, WALL_RIGHT) - wall_size / 2;
+	if (right - left > width) {
+		const float gap = (right - left - width) / (to - from + 1);
+		float edge = left;
+		for (int i = from; i < to; ++i) {
+			edge += gap;
+			this->position[i] = edge + this->size[i] / 2;
+			edge += this->size[i];
+		}
+		return;
+	}
+	const int slots = to + 2;
+	for (int j = 0; j < to; ++j) {
+		this->position[j] = interp2f(1, this->num_leds - 2, j + 1, 0, slots - 1);
+	}
+}
+
+void particles_set_quality(struct particles *this, int level)
+{
+	int n = this->max_particles * quality_particles[level] + 0.5f;
+	if (n < 1) {
+		n = 1;
+	}
+	if (n != this->num_particles) {
+		/*
+		 * Dropped particles keep their velocity and colour for when they
+		 * come back, but not their place.  Rescale the energy targets so
+		 * conservation doesn't pump the remaining particles up to the old
+		 * total.
+		 */
+		const float before = particles_calc_energy(this);
+		if (n > this->num_particles) {
+			place_returning(this, this->num_particles, n);
+		}
+		this->num_particles = n;
+		const float after = particles_calc_energy(this);
+		if (before > 0) {
+			this->total_energy *= after / before;
+			this->base_energy *= after / before;
+		}
+	}
+	/* Old footprints are still in drawn, so they get cleared next frame */
+	this->splat_width = quality_splat_width[level];
+}
+
+/* Render palette indices instead, one colour per particle and white for the walls */
+int particles_set_indexed(struct particles *this, struct indexed *indexed)
+{
+	this->palette = palette_init(this->max_particles + 1);
+	if (!this->palette) {
+		return -1;
+	}
+	for (int i = 0; i < this->max_particles; ++i) {
+		palette_set(this->palette, i, &this->colour[i]);
+	}
+	palette_set(this->palette, this->max_particles, &white);
+	palette_commit(this->palette);
+	if (indexed_set_palette(indexed, this->palette) != 0) {
+		return -1;
+	}
+	this->indexed = indexed;
+	/* Clear the whole strip again, in the new framebuffer */
+	dirty_all(&this->drawn, this->num_leds);
+	return 0;
 }
 
 void particles_free(struct particles *this)
@@ -295,8 +487,11 @@ void particles_free(struct particles *this)
 	if (!this) {
 		return;
 	}
-	if (this->particles) {
-		free(this->particles);
-	}
+	free(this->position);
+	free(this->velocity);
+	free(this->mass);
+	free(this->size);
+	free(this->colour);
+	palette_free(this->palette);
 	free(this);
 }
@@ -3,29 +3,49 @@
 #include "led.h"
 #include "timing.h"
 #include "colour.h"
+#include "audio.h"
+#include "dirty.h"
+#include "quality.h"
+#include "palette.h"
 
-struct particle
-{
-	float position;
-	float velocity;
-	float next_position;
-	float next_velocity;
-	float mass;
-	float size;
-	struct rgb colour;
-	int immobile;
-};
-
+/*
+ * Planar particle store, mobile particles only.  The walls at either end
+ * of the strip are immobile and handled separately by the physics.
+ */
 struct particles
 {
 	size_t num_leds;
 	struct led *leds;
 	struct timing timing;
+	/* Active particles, fewer than allocated at lower quality */
 	int num_particles;
-	struct particle *particles;
+	int max_particles;
+	/* Reach of each splat, in units of particle size */
+	float splat_width;
+	float *position;
+	float *velocity;
+	float *mass;
+	float *size;
+	struct rgb *colour;
 	float total_energy;
+	/* Footprints drawn last frame, and union of old and new footprints */
+	struct dirty drawn;
+	struct dirty dirty;
+	/* Optional, rendered into instead of leds, with a colour per particle */
+	struct indexed *indexed;
+	struct palette *palette;
+	/* Optional, bass kicks inject velocity which then relaxes back */
+	const struct audio *audio;
+	unsigned kicks_seen;
+	float base_energy;
 };
 
 struct particles *particles_init(size_t num_leds, struct led *leds, int num_particles, float min_velocity, float max_velocity, float min_size, float max_size);
 void particles_run(struct particles *this);
+void particles_set_quality(struct particles *this, int level);
+int particles_set_indexed(struct particles *this, struct indexed *indexed);
 void particles_free(struct particles *this);
+
+void particles_propagate(struct particles *this, float dt);
+float particles_calc_energy(const struct particles *this);
+void particles_conserve_energy(struct particles *this);
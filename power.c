@@ -0,0 +1,87 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "power.h"
+#include "trace.h"
+
+/* Controller draw of a dark LED, about the same for APA102 and WS2812 */
+static const double idle_ma = 1;
+
+struct power *power_init(size_t num_leds, double budget, double unit)
+{
+	struct power *this = malloc(sizeof(*this));
+	if (!this) {
+		perror("malloc");
+		goto fail;
+	}
+	memset(this, 0, sizeof(*this));
+	this->budget = budget;
+	this->unit = unit;
+	this->idle = idle_ma;
+	this->num_leds = num_leds;
+	this->min_scale = 1;
+	this->draw = calloc(num_leds, sizeof(*this->draw));
+	if (!this->draw) {
+		perror("calloc");
+		goto fail;
+	}
+	if (budget <= idle_ma * num_leds) {
+		fprintf(stderr, "Power: budget %.0f mA is below the %.0f mA idle draw\n",
+				budget, idle_ma * num_leds);
+		errno = EINVAL;
+		goto fail;
+	}
+	return this;
+fail:
+	power_free(this);
+	return NULL;
+}
+
+float power_frame(struct power *this)
+{
+	const double draw = this->total * this->unit;
+	const double available = this->budget - this->idle * this->num_leds;
+	const float scale = draw > available ? available / draw : 1;
+	this->frames++;
+	this->scale_sum += scale;
+	if (draw + this->idle * this->num_leds > this->peak) {
+		this->peak = draw + this->idle * this->num_leds;
+	}
+	if (scale < 1) {
+		TRACE2(power_limit, (long) draw, (long) (scale * 1000));
+		this->events += !this->limited;
+		this->limited_frames++;
+		if (scale < this->min_scale) {
+			this->min_scale = scale;
+		}
+	}
+	this->limited = scale < 1;
+	return scale;
+}
+
+void power_report(const struct power *this)
+{
+	if (!this->frames) {
+		return;
+	}
+	fprintf(stderr, "Power: budget %.0f mA, peak estimate %.0f mA, %llu frames limited (%.1f%%) in %llu events\n",
+			this->budget, this->peak,
+			(unsigned long long) this->limited_frames,
+			this->limited_frames * 100.0 / this->frames,
+			(unsigned long long) this->events);
+	if (this->limited_frames) {
+		fprintf(stderr, "Power: mean scale %.3f, lowest %.3f\n",
+				this->scale_sum / this->frames, this->min_scale);
+	}
+}
+
+void power_free(struct power *this)
+{
+	if (!this) {
+		return;
+	}
+	free(this->draw);
+	free(this);
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Estimates each frame's current draw while it is encoded and, over the
+ * budget, gives the scale that brings it back within.  Encoders account
+ * each LED they encode in their own units (wire bytes summed, times the
+ * global field on APA102), the LEDs they skip keep their last draw.
+ */
+struct power
+{
+	double budget;
+	/* mA per encoder unit, and quiescent mA per LED */
+	double unit;
+	double idle;
+	size_t num_leds;
+	/* Last accounted draw per LED, and their sum, in encoder units */
+	uint32_t *draw;
+	uint64_t total;
+	/* Previous wire buffer was scaled, so must be re-encoded in full */
+	int limited;
+	/* Statistics */
+	uint64_t frames;
+	uint64_t limited_frames;
+	uint64_t events;
+	double peak;
+	double min_scale;
+	double scale_sum;
+};
+
+struct power *power_init(size_t num_leds, double budget, double unit);
+/* Scale for the frame just encoded, 1 if within budget */
+float power_frame(struct power *this);
+void power_report(const struct power *this);
+void power_free(struct power *this);
+
+static inline void power_account(struct power *this, size_t i, uint32_t draw)
+{
+	this->total += draw;
+	this->total -= this->draw[i];
+	this->draw[i] = draw;
+}
@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "quality.h"
+
+/* Fraction of the budget to step down above, and to step up below */
+static const double high_water = 0.9;
+static const double low_water = 0.6;
+/* Step back up only if the better level was last measured under this */
+static const double restore_water = 0.8;
+static const double smoothing = 0.1;
+/* Frames a condition must persist before acting, and after a change */
+static const int down_frames = 8;
+static const int up_frames = 120;
+static const int settle_frames = 30;
+
+/* Simulation ticks per output frame are divided by this at each level */
+static const int sim_factor[QUALITY_LEVELS] = { 1, 1, 1, 2, 4 };
+
+struct quality *quality_init(double budget)
+{
+	struct quality *this = malloc(sizeof(*this));
+	if (!this) {
+		perror("malloc");
+		goto fail;
+	}
+	memset(this, 0, sizeof(*this));
+	this->budget = budget;
+	this->hold = settle_frames;
+	return this;
+fail:
+	quality_free(this);
+	return NULL;
+}
+
+static void change_level(struct quality *this, int level)
+{
+	fprintf(stderr, "Quality: level %d -> %d (render %.2f ms, budget %.2f ms)\n",
+			this->level, level, this->average * 1e3, this->budget * 1e3);
+	this->cost[this->level] = this->average;
+	this->level = level;
+	this->over = 0;
+	this->under = 0;
+	this->hold = settle_frames;
+	this->changes++;
+}
+
+/* Returns non-zero when the level has changed */
+int quality_update(struct quality *this, double render_time)
+{
+	this->frames++;
+	this->frames_at[this->level]++;
+	if (render_time > this->budget) {
+		this->missed++;
+	}
+	if (this->hold > 0) {
+		/* Let the new level settle before judging it */
+		this->hold--;
+		this->average = render_time;
+		return 0;
+	}
+	this->average += (render_time - this->average) * smoothing;
+	this->over = this->average > this->budget * high_water ? this->over + 1 : 0;
+	this->under = this->average < this->budget * low_water ? this->under + 1 : 0;
+	if (this->over >= down_frames && this->level < QUALITY_LEVELS - 1) {
+		change_level(this, this->level + 1);
+		return 1;
+	}
+	if (this->under >= up_frames && this->level > 0) {
+		const double better = this->cost[this->level - 1];
+		if (better > this->budget * restore_water) {
+			/* Forget it slowly, so we retry once conditions have changed */
+			this->cost[this->level - 1] = better * (1 - smoothing);
+			this->under = 0;
+			return 0;
+		}
+		change_level(this, this->level - 1);
+		return 1;
+	}
+	return 0;
+}
+
+int quality_sim_factor(int level)
+{
+	return sim_factor[level];
+}
+
+void quality_report(const struct quality *this)
+{
+	if (!this->frames) {
+		return;
+	}
+	fprintf(stderr, "Quality: level %d of %d, %llu changes, %.1f%% of frames over budget\n",
+			this->level, QUALITY_LEVELS - 1,
+			(unsigned long long) this->changes,
+			this->missed * 100.0 / this->frames);
+	fprintf(stderr, "Quality: frames at each level:");
+	for (int i = 0; i < QUALITY_LEVELS; ++i) {
+		fprintf(stderr, " %.1f%%", this->frames_at[i] * 100.0 / this->frames);
+	}
+	fprintf(stderr, "\n");
+}
+
+void quality_free(struct quality *this)
+{
+	if (!this) {
+		return;
+	}
+	free(this);
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <stdint.h>
+
+/* Level 0 is full quality, each level trades detail for render time */
+#define QUALITY_LEVELS 5
+
+/*
+ * Watches render time against the frame budget and steps the quality
+ * level down when the deadline is being missed, and back up once there
+ * is headroom.  Animations map the level onto their own knobs.
+ */
+struct quality
+{
+	double budget;
+	int level;
+	/* Smoothed render time, overall and as last seen at each level */
+	double average;
+	double cost[QUALITY_LEVELS];
+	/* Consecutive frames over/under the thresholds, and settling time */
+	int over;
+	int under;
+	int hold;
+	/* Statistics */
+	uint64_t frames;
+	uint64_t missed;
+	uint64_t changes;
+	uint64_t frames_at[QUALITY_LEVELS];
+};
+
+struct quality *quality_init(double budget);
+int quality_update(struct quality *this, double render_time);
+int quality_sim_factor(int level);
+void quality_report(const struct quality *this);
+void quality_free(struct quality *this);
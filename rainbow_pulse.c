@@ -5,11 +5,15 @@
 
 #include "rainbow_pulse.h"
 #include "colour.h"
+#include "util.h"
 
 static const float brightness_time_wavelength = -0.4f;
 static const float brightness_space_wavelength = 160.f;
 static const float hue_time_wavelength = 1.0f;
 static const float hue_space_wavelength = 60.f;
+static const float audio_hue_shift = 0.3f;
+
+static const int quality_hsv_stride[QUALITY_LEVELS] = { 1, 2, 4, 8, 8 };
 
 struct rainbow_pulse *rainbow_pulse_init(size_t num_leds, struct led *leds)
 {
@@ -27,6 +31,7 @@ struct rainbow_pulse *rainbow_pulse_init(size_t num_leds, struct led *leds)
 	this->leds = leds;
 	this->h_time_phase = 0;
 	this->s_time_phase = 0;
+	this->hsv_stride = 1;
 	return this;
 fail:
 	rainbow_pulse_free(this);
@@ -38,28 +43,71 @@ static void phase_step(float *phase, float dt, float wavelength)
 	*phase = fmodf(*phase + dt / wavelength, M_PI * 2);
 }
 
+static void shade(const struct rainbow_pulse *this, size_t i)
+{
+	const struct audio *audio = this->audio;
+	struct led *led = this->leds + i;
+	float rainbow_space = i;
+	float pulse_space = powf(i * 1.0f / this->num_leds, 1.5f) * this->num_leds;
+	led->brightness = 1;
+	float pulse = expf(-2000 * (sinf(
+					this->s_time_phase +
+					pulse_space / brightness_space_wavelength
+				       ) * 0.5f + 0.5f));
+	struct hsv hsv = {
+		.h = sinf(this->h_time_phase) +
+			rainbow_space / hue_space_wavelength,
+		.s = 1 - pulse
+	};
+	hsv.v = (1 + 19 * pulse) / 20;
+	if (audio) {
+		/* Bass at the start of the strip, treble at the end */
+		float band = audio->bands[i * AUDIO_BANDS / this->num_leds];
+		hsv.h += band * audio_hue_shift;
+		hsv.v = fmaxf(hsv.v, band * band);
+	}
+	hsv2rgb(&hsv, &led->colour);
+}
+
 void rainbow_pulse_run(struct rainbow_pulse *this)
 {
 	float dt = timing_step(&this->timing);
+	if (this->audio) {
+		/* Louder music cycles the hue faster */
+		dt *= 1 + 4 * this->audio->level;
+	}
 	phase_step(&this->h_time_phase, dt, hue_time_wavelength);
 	phase_step(&this->s_time_phase, dt, brightness_time_wavelength);
-	for (size_t i = 0; i < this->num_leds; ++i) {
-		struct led *led = this->leds + i;
-		float rainbow_space = i;
-		float pulse_space = powf(i * 1.0f / this->num_leds, 1.5f) * this->num_leds;
-		led->brightness = 1;
-		float pulse = expf(-2000 * (sinf(
-						this->s_time_phase +
-						pulse_space / brightness_space_wavelength
-					       ) * 0.5f + 0.5f));
-		struct hsv hsv = {
-			.h = sinf(this->h_time_phase) +
-				rainbow_space / hue_space_wavelength,
-			.s = 1 - pulse
-		};
-		hsv.v = (1 + 19 * pulse) / 20;
-		hsv2rgb(&hsv, &led->colour);
+	const size_t stride = this->hsv_stride;
+	for (size_t i = 0; i < this->num_leds; i += stride) {
+		shade(this, i);
 	}
+	if (stride == 1 || this->num_leds < 2) {
+		return;
+	}
+	const size_t last = this->num_leds - 1;
+	if (last % stride) {
+		shade(this, last);
+	}
+	/* Blend between evaluated LEDs */
+	for (size_t i = 0; i < last; i += stride) {
+		const size_t j = i + stride < last ? i + stride : last;
+		const struct led *a = this->leds + i;
+		const struct led *b = this->leds + j;
+		for (size_t k = i + 1; k < j; ++k) {
+			const float alpha = (float) (k - i) / (j - i);
+			struct led *led = this->leds + k;
+			led->brightness = interpf(a->brightness, b->brightness, alpha);
+			led->colour.r = interpf(a->colour.r, b->colour.r, alpha);
+			led->colour.g = interpf(a->colour.g, b->colour.g, alpha);
+			led->colour.b = interpf(a->colour.b, b->colour.b, alpha);
+		}
+	}
+}
+
+void rainbow_pulse_set_quality(struct rainbow_pulse *this, int level)
+{
+	this->hsv_stride = quality_hsv_stride[level];
 }
 
 void rainbow_pulse_free(struct rainbow_pulse *this)
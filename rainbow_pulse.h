@@ -2,6 +2,8 @@
 
 #include "led.h"
 #include "timing.h"
+#include "audio.h"
+#include "quality.h"
 
 struct rainbow_pulse
 {
@@ -10,8 +12,13 @@ struct rainbow_pulse
 	struct timing timing;
 	float h_time_phase;
 	float s_time_phase;
+	/* Evaluate every nth LED and interpolate between */
+	int hsv_stride;
+	/* Optional, drives hue and brightness per band */
+	const struct audio *audio;
 };
 
 struct rainbow_pulse *rainbow_pulse_init(size_t num_leds, struct led *leds);
 void rainbow_pulse_run(struct rainbow_pulse *this);
+void rainbow_pulse_set_quality(struct rainbow_pulse *this, int level);
 void rainbow_pulse_free(struct rainbow_pulse *this);
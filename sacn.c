@@ -0,0 +1,434 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <time.h>
+
+#include "sacn.h"
+
+static const uint8_t acn_identifier[12] = "ASC-E1.17\0\0";
+static const uint8_t artnet_identifier[8] = "Art-Net";
+
+#define E131_HEADER 126
+#define ARTNET_HEADER 18
+#define ARTNET_OP_DMX 0x5000
+#define E131_VECTOR_ROOT_DATA 0x00000004
+#define E131_VECTOR_FRAMING_DATA 0x00000002
+#define E131_VECTOR_DMP_SET_PROPERTY 0x02
+#define E131_OPTION_PREVIEW 0x40
+
+/* Sequence numbers within this distance behind the last are stale (E1.31 6.7.2) */
+#define SEQUENCE_WINDOW 20
+
+struct sacn_batch
+{
+	struct mmsghdr msgs[SACN_BATCH];
+	struct iovec iov[SACN_BATCH];
+	uint8_t buf[SACN_BATCH][SACN_MAX_PACKET];
+	/* SCM_TIMESTAMPNS of each packet */
+	uint8_t control[SACN_BATCH][CMSG_SPACE(sizeof(struct timespec))];
+};
+
+static float channel_value[256];
+
+static unsigned be16(const uint8_t *p)
+{
+	return p[0] << 8 | p[1];
+}
+
+static unsigned long be32(const uint8_t *p)
+{
+	return (unsigned long) be16(p) << 16 | be16(p + 2);
+}
+
+static void put_be16(uint8_t *p, unsigned value)
+{
+	p[0] = value >> 8;
+	p[1] = value;
+}
+
+static void put_be32(uint8_t *p, unsigned long value)
+{
+	put_be16(p, value >> 16);
+	put_be16(p + 2, value);
+}
+
+static int open_socket(int port)
+{
+	int fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0) {
+		perror("socket");
+		return -1;
+	}
+	int one = 1;
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0) {
+		perror("SO_REUSEADDR");
+	}
+	/* Absorb bursts of universes between output ticks */
+	int rcvbuf = 4 << 20;
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)) != 0) {
+		perror("SO_RCVBUF");
+	}
+	/* Kernel receive time, for input-to-photon latency */
+	if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one)) != 0) {
+		perror("SO_TIMESTAMPNS");
+	}
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_port = htons(port),
+		.sin_addr = { .s_addr = htonl(INADDR_ANY) }
+	};
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+		perror("bind");
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/* E1.31 multicasts universe u to 239.255.u_hi.u_lo, unicast works without this */
+static void join_multicast(int fd, int universe)
+{
+	struct ip_mreq mreq = {
+		.imr_multiaddr = { .s_addr = htonl(0xefff0000 | (universe & 0xffff)) },
+		.imr_interface = { .s_addr = htonl(INADDR_ANY) }
+	};
+	setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq));
+}
+
+struct sacn *sacn_init(size_t num_leds, struct led *leds, int first_universe, int e131_port, int artnet_port)
+{
+	struct sacn *this = malloc(sizeof(*this));
+	if (!this) {
+		perror("malloc");
+		return NULL;
+	}
+	memset(this, 0, sizeof(*this));
+	this->e131_fd = -1;
+	this->artnet_fd = -1;
+	this->num_leds = num_leds;
+	this->leds = leds;
+	this->first_universe = first_universe;
+	this->num_universes = (num_leds + SACN_LEDS_PER_UNIVERSE - 1) / SACN_LEDS_PER_UNIVERSE;
+	if (this->num_universes > SACN_MAX_UNIVERSES) {
+		fprintf(stderr, "sACN: at most %d universes (%d LEDs)\n",
+				SACN_MAX_UNIVERSES, SACN_MAX_UNIVERSES * SACN_LEDS_PER_UNIVERSE);
+		goto fail;
+	}
+	for (int i = 0; i < 256; ++i) {
+		channel_value[i] = i / 255.0f;
+	}
+	for (int u = 0; u < SACN_MAX_UNIVERSES; ++u) {
+		this->last_sequence[u] = -1;
+	}
+	this->back = calloc(num_leds, sizeof(*this->back));
+	this->ready = calloc(num_leds, sizeof(*this->ready));
+	this->batch = calloc(1, sizeof(*this->batch));
+	if (!this->back || !this->ready || !this->batch) {
+		perror("calloc");
+		goto fail;
+	}
+	struct sacn_batch *batch = this->batch;
+	for (int i = 0; i < SACN_BATCH; ++i) {
+		batch->iov[i] = (struct iovec) { .iov_base = batch->buf[i], .iov_len = sizeof(batch->buf[i]) };
+		batch->msgs[i].msg_hdr.msg_iov = &batch->iov[i];
+		batch->msgs[i].msg_hdr.msg_iovlen = 1;
+		batch->msgs[i].msg_hdr.msg_control = batch->control[i];
+	}
+	if (e131_port) {
+		this->e131_fd = open_socket(e131_port);
+		if (this->e131_fd < 0) {
+			goto fail;
+		}
+		for (int u = 0; u < this->num_universes; ++u) {
+			join_multicast(this->e131_fd, first_universe + u);
+		}
+	}
+	if (artnet_port) {
+		this->artnet_fd = open_socket(artnet_port);
+		if (this->artnet_fd < 0) {
+			goto fail;
+		}
+	}
+	/* Black until the first complete frame */
+	dirty_all(&this->dirty, num_leds);
+	for (struct led *led = leds, *end = leds + num_leds; led != end; ++led) {
+		*led = LED_INIT;
+	}
+	return this;
+fail:
+	sacn_free(this);
+	return NULL;
+}
+
+static void complete_frame(struct sacn *this, enum latency_source source, double arrival)
+{
+	if (this->ready_new) {
+		this->superseded++;
+		latency_superseded(this->latency, this->ready_origin.source);
+	}
+	struct led *tmp = this->ready;
+	this->ready = this->back;
+	this->back = tmp;
+	this->ready_new = 1;
+	this->ready_origin = (struct frame_origin) { .source = source, .time = arrival };
+	this->complete++;
+	memset(this->received, 0, sizeof(this->received));
+}
+
+/* sequence in 0..period-1, or < 0 if the sender doesn't number its packets */
+static void receive_universe(struct sacn *this, enum latency_source source, double arrival, int universe, int sequence, int period, const uint8_t *data, size_t len)
+{
+	const int u = universe - this->first_universe;
+	if (u < 0 || u >= this->num_universes) {
+		this->ignored++;
+		return;
+	}
+	if (sequence >= 0 && this->last_sequence[u] >= 0) {
+		/* Distance forward around the sequence, taken as behind past halfway */
+		int diff = (sequence - this->last_sequence[u] + period) % period;
+		if (diff > period / 2) {
+			diff -= period;
+		}
+		if (diff <= 0 && diff > -SEQUENCE_WINDOW) {
+			this->reordered++;
+			return;
+		}
+		if (diff > 1) {
+			this->lost += diff - 1;
+		}
+	}
+	this->last_sequence[u] = sequence;
+	uint64_t *word = &this->received[u / 64];
+	const uint64_t bit = 1ull << (u % 64);
+	if (*word & bit) {
+		/* Next frame has started before this one completed */
+		this->incomplete++;
+		memset(this->received, 0, sizeof(this->received));
+	}
+	/* Straight from the packet into the frame */
+	const size_t base = (size_t) u * SACN_LEDS_PER_UNIVERSE;
+	size_t count = len / 3;
+	if (count > this->num_leds - base) {
+		count = this->num_leds - base;
+	}
+	struct led *led = this->back + base;
+	for (size_t i = 0; i < count; ++i, ++led, data += 3) {
+		led->brightness = 1;
+		led->colour.r = channel_value[data[0]];
+		led->colour.g = channel_value[data[1]];
+		led->colour.b = channel_value[data[2]];
+	}
+	*word |= bit;
+	this->universes++;
+	for (int w = 0; w < (this->num_universes + 63) / 64; ++w) {
+		const int bits = this->num_universes - w * 64;
+		const uint64_t full = bits >= 64 ? ~0ull : (1ull << bits) - 1;
+		if (this->received[w] != full) {
+			return;
+		}
+	}
+	complete_frame(this, source, arrival);
+}
+
+static void parse_e131(struct sacn *this, const uint8_t *buf, size_t len, double arrival)
+{
+	if (len < E131_HEADER ||
+			be16(buf) != 0x0010 ||
+			memcmp(buf + 4, acn_identifier, sizeof(acn_identifier)) != 0 ||
+			be32(buf + 18) != E131_VECTOR_ROOT_DATA ||
+			be32(buf + 40) != E131_VECTOR_FRAMING_DATA ||
+			buf[117] != E131_VECTOR_DMP_SET_PROPERTY ||
+			buf[125] != 0 ||
+			be16(buf + 123) == 0 ||
+			(buf[112] & E131_OPTION_PREVIEW)) {
+		this->ignored++;
+		return;
+	}
+	/* Property count includes the start code */
+	size_t slots = be16(buf + 123) - 1;
+	if (slots > len - E131_HEADER) {
+		slots = len - E131_HEADER;
+	}
+	receive_universe(this, LATENCY_E131, arrival, be16(buf + 113), buf[111], 256, buf + E131_HEADER, slots);
+}
+
+static void parse_artnet(struct sacn *this, const uint8_t *buf, size_t len, double arrival)
+{
+	if (len < ARTNET_HEADER ||
+			memcmp(buf, artnet_identifier, sizeof(artnet_identifier)) != 0 ||
+			(buf[8] | buf[9] << 8) != ARTNET_OP_DMX) {
+		this->ignored++;
+		return;
+	}
+	size_t slots = be16(buf + 16);
+	if (slots > len - ARTNET_HEADER) {
+		slots = len - ARTNET_HEADER;
+	}
+	/* Sequence 0 means sequencing is disabled, otherwise it runs 1..255 */
+	receive_universe(this, LATENCY_ARTNET, arrival, buf[14] | (buf[15] & 0x7f) << 8, buf[12] - 1, 255, buf + ARTNET_HEADER, slots);
+}
+
+static double seconds(const struct timespec *t)
+{
+	return t->tv_sec + t->tv_nsec * 1e-9;
+}
+
+/* Receive time on CLOCK_MONOTONIC, or now if the kernel didn't stamp it */
+static double arrival_time(struct msghdr *msg, double realtime_offset, double now)
+{
+	for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+			struct timespec stamp;
+			memcpy(&stamp, CMSG_DATA(cmsg), sizeof(stamp));
+			return seconds(&stamp) - realtime_offset;
+		}
+	}
+	return now;
+}
+
+static int drain(struct sacn *this, int fd, void (*parse)(struct sacn *, const uint8_t *, size_t, double))
+{
+	while (1) {
+		struct sacn_batch *batch = this->batch;
+		for (int i = 0; i < SACN_BATCH; ++i) {
+			batch->msgs[i].msg_hdr.msg_controllen = sizeof(batch->control[i]);
+		}
+		int n = recvmmsg(fd, batch->msgs, SACN_BATCH, MSG_DONTWAIT, NULL);
+		if (n < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+				return 0;
+			}
+			perror("recvmmsg");
+			return -1;
+		}
+		/* Timestamps are CLOCK_REALTIME, frames are timed on CLOCK_MONOTONIC */
+		struct timespec realtime;
+		struct timespec monotonic;
+		clock_gettime(CLOCK_REALTIME, &realtime);
+		clock_gettime(CLOCK_MONOTONIC, &monotonic);
+		const double now = seconds(&monotonic);
+		const double realtime_offset = seconds(&realtime) - now;
+		for (int i = 0; i < n; ++i) {
+			const double arrival = arrival_time(&batch->msgs[i].msg_hdr, realtime_offset, now);
+			parse(this, batch->buf[i], batch->msgs[i].msg_len, arrival);
+		}
+		this->packets += n;
+		if (n < SACN_BATCH) {
+			return 0;
+		}
+	}
+}
+
+int sacn_poll(struct sacn *this)
+{
+	if (this->e131_fd >= 0 && drain(this, this->e131_fd, parse_e131) != 0) {
+		return -1;
+	}
+	if (this->artnet_fd >= 0 && drain(this, this->artnet_fd, parse_artnet) != 0) {
+		return -1;
+	}
+	return 0;
+}
+
+void sacn_run(struct sacn *this)
+{
+	dirty_clear(&this->dirty);
+	this->origin.time = 0;
+	/* Already reported by perror, a complete frame is still worth presenting */
+	if (sacn_poll(this) != 0) {
+		this->errors++;
+	}
+	if (!this->ready_new) {
+		return;
+	}
+	/*
+	 * leds belongs to the caller (a zone's slice, or the interpolator's
+	 * target), so the ready frame is copied rather than swapped in.
+	 */
+	memcpy(this->leds, this->ready, sizeof(*this->leds) * this->num_leds);
+	dirty_add(&this->dirty, 0, this->num_leds);
+	this->origin = this->ready_origin;
+	this->ready_new = 0;
+	this->presented++;
+}
+
+void sacn_report(const struct sacn *this)
+{
+	fprintf(stderr, "sACN: %llu packets, %llu universes, %llu lost, %llu reordered, %llu ignored, %llu receive errors\n",
+			(unsigned long long) this->packets,
+			(unsigned long long) this->universes,
+			(unsigned long long) this->lost,
+			(unsigned long long) this->reordered,
+			(unsigned long long) this->ignored,
+			(unsigned long long) this->errors);
+	fprintf(stderr, "sACN: %llu frames complete, %llu incomplete, %llu superseded, %llu presented\n",
+			(unsigned long long) this->complete,
+			(unsigned long long) this->incomplete,
+			(unsigned long long) this->superseded,
+			(unsigned long long) this->presented);
+}
+
+void sacn_free(struct sacn *this)
+{
+	if (!this) {
+		return;
+	}
+	if (this->e131_fd >= 0) {
+		close(this->e131_fd);
+	}
+	if (this->artnet_fd >= 0) {
+		close(this->artnet_fd);
+	}
+	free(this->back);
+	free(this->ready);
+	free(this->batch);
+	free(this);
+}
+
+size_t sacn_build_e131(uint8_t *buf, int universe, uint8_t sequence, const uint8_t *data, size_t len)
+{
+	const size_t total = E131_HEADER + len;
+	memset(buf, 0, E131_HEADER);
+	/* Root layer */
+	put_be16(buf, 0x0010);
+	memcpy(buf + 4, acn_identifier, sizeof(acn_identifier));
+	put_be16(buf + 16, 0x7000 | (total - 16));
+	put_be32(buf + 18, E131_VECTOR_ROOT_DATA);
+	memcpy(buf + 22, "pi-led-strip cid", 16);
+	/* Framing layer */
+	put_be16(buf + 38, 0x7000 | (total - 38));
+	put_be32(buf + 40, E131_VECTOR_FRAMING_DATA);
+	strcpy((char *) buf + 44, "pi-led-strip");
+	buf[108] = 100;
+	buf[111] = sequence;
+	put_be16(buf + 113, universe);
+	/* DMP layer */
+	put_be16(buf + 115, 0x7000 | (total - 115));
+	buf[117] = E131_VECTOR_DMP_SET_PROPERTY;
+	buf[118] = 0xa1;
+	put_be16(buf + 121, 1);
+	put_be16(buf + 123, len + 1);
+	memcpy(buf + E131_HEADER, data, len);
+	return total;
+}
+
+size_t sacn_build_artnet(uint8_t *buf, int universe, uint8_t sequence, const uint8_t *data, size_t len)
+{
+	memset(buf, 0, ARTNET_HEADER);
+	memcpy(buf, artnet_identifier, sizeof(artnet_identifier));
+	buf[8] = ARTNET_OP_DMX & 0xff;
+	buf[9] = ARTNET_OP_DMX >> 8;
+	buf[11] = 14;
+	buf[12] = sequence;
+	buf[14] = universe;
+	buf[15] = (universe >> 8) & 0x7f;
+	put_be16(buf + 16, len);
+	memcpy(buf + ARTNET_HEADER, data, len);
+	return ARTNET_HEADER + len;
+}
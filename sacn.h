@@ -0,0 +1,66 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include "led.h"
+#include "dirty.h"
+#include "latency.h"
+
+#define SACN_PORT 5568
+#define ARTNET_PORT 6454
+/* RGB LEDs per DMX universe, 510 of the 512 slots */
+#define SACN_LEDS_PER_UNIVERSE 170
+#define SACN_MAX_UNIVERSES 256
+#define SACN_MAX_PACKET 638
+#define SACN_BATCH 32
+
+struct sacn_batch;
+
+/*
+ * Receives E1.31 (sACN) and Art-Net DMX universes and assembles them into
+ * frames.  The newest complete frame is presented on each run.
+ */
+struct sacn
+{
+	size_t num_leds;
+	struct led *leds;
+	int first_universe;
+	int num_universes;
+	int e131_fd;
+	int artnet_fd;
+	/* Frame being assembled, and newest complete frame */
+	struct led *back;
+	struct led *ready;
+	int ready_new;
+	/* Arrival of the ready frame, and of the frame presented by the last run */
+	struct frame_origin ready_origin;
+	struct frame_origin origin;
+	/* Optional, told about frames superseded before being presented */
+	struct latency *latency;
+	uint64_t received[SACN_MAX_UNIVERSES / 64];
+	int last_sequence[SACN_MAX_UNIVERSES];
+	struct dirty dirty;
+	/* Batched receive buffers */
+	struct sacn_batch *batch;
+	/* Statistics */
+	uint64_t packets;
+	uint64_t universes;
+	uint64_t lost;
+	/* Duplicate or behind the last in sequence, dropped */
+	uint64_t reordered;
+	uint64_t ignored;
+	uint64_t errors;
+	uint64_t incomplete;
+	uint64_t complete;
+	uint64_t superseded;
+	uint64_t presented;
+};
+
+struct sacn *sacn_init(size_t num_leds, struct led *leds, int first_universe, int e131_port, int artnet_port);
+int sacn_poll(struct sacn *this);
+void sacn_run(struct sacn *this);
+void sacn_report(const struct sacn *this);
+void sacn_free(struct sacn *this);
+
+size_t sacn_build_e131(uint8_t *buf, int universe, uint8_t sequence, const uint8_t *data, size_t len);
+size_t sacn_build_artnet(uint8_t *buf, int universe, uint8_t sequence, const uint8_t *data, size_t len);
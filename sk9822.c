@@ -4,31 +4,10 @@
 #include <stdint.h>
 #include <string.h>
 #include <unistd.h>
-#include <fcntl.h>
-#include <sys/ioctl.h>
-#include <linux/types.h>
-#include <linux/spi/spidev.h>
 
 #include "sk9822.h"
-
-#define spi_config(fd, name, value) (_spi_config(fd, #name, SPI_IOC_RD_##name, SPI_IOC_WR_##name, value))
-
-static int _spi_config(int fd, const char *name, int read_code, int write_code, int value)
-{
-	if (ioctl(fd, write_code, &value) != 0) {
-		perror("ioctl read");
-		return 1;
-	}
-	int verify = 0;
-	if (ioctl(fd, read_code, &verify) != 0) {
-		perror("ioctl write");
-		return 1;
-	}
-	if (value != verify) {
-		fprintf(stderr, "ioctl write successful but value not set exactly for %s: write %d, read %d\n", name, value, verify);
-	}
-	return 0;
-}
+#include "spi.h"
+#include "trace.h"
 
 struct sk9822 *sk9822_init(const char *spidev, int speed, size_t num_leds)
 {
@@ -37,29 +16,25 @@ struct sk9822 *sk9822_init(const char *spidev, int speed, size_t num_leds)
 		return NULL;
 	}
 	memset(this, 0, sizeof(*this));
-	this->fd = open(spidev, O_RDWR);
-	if (this->fd < 0) {
-		perror("open(spidev)");
-		goto fail;
-	}
-	if (spi_config(this->fd, MODE, SPI_NO_CS) != 0) {
-		perror("MODE");
-		goto fail;
-	}
-	if (spi_config(this->fd, BITS_PER_WORD, 8) != 0) {
-		perror("BITS_PER_WORD");
-		goto fail;
-	}
-	if (spi_config(this->fd, MAX_SPEED_HZ, speed) != 0) {
-		perror("MAX_SPEED_HZ");
-		goto fail;
-	}
+	this->fd = -1;
 	this->num_leds = num_leds;
 	this->leds = malloc(sizeof(*this->leds) * num_leds);
 	if (!this->leds) {
 		perror("malloc");
 		goto fail;
 	}
+	/* Start frame, LED frames, end frame (zeros) */
+	this->message_size = sizeof(uint32_t) * (num_leds + 2 + num_leds / 64);
+	this->message = calloc(this->message_size, 1);
+	if (!this->message) {
+		perror("calloc");
+		goto fail;
+	}
+	this->fd = spi_open(spidev, speed, this->message_size);
+	if (this->fd < 0) {
+		goto fail;
+	}
+	dirty_all(&this->dirty, num_leds);
 	return this;
 fail:
 	sk9822_free(this);
@@ -74,8 +49,14 @@ void sk9822_free(struct sk9822 *this)
 	if (this->leds) {
 		free(this->leds);
 	}
+	if (this->message) {
+		free(this->message);
+	}
+	if (this->calibrated_palette) {
+		free(this->calibrated_palette);
+	}
 	if (this->fd >= 0) {
-		if (!close(this->fd)) {
+		if (close(this->fd) != 0) {
 			perror("close");
 		}
 	}
@@ -84,33 +65,124 @@ void sk9822_free(struct sk9822 *this)
 
 static int clamp(float value)
 {
-	return value < 0 ? 0 : value > 1 ? 255 : (int) roundf(value * 255);
+	return !(value > 0) ? 0 : value > 1 ? 255 : (int) roundf(value * 255);
+}
+
+/* Recolouring changes every LED's wire bytes, calibration is per colour */
+static int check_palette(struct sk9822 *this, const struct palette *palette)
+{
+	if (palette != this->palette || palette->generation != this->palette_generation) {
+		if (this->calibration && calibration_palette(this->calibration, palette, &this->calibrated_palette) != 0) {
+			return -1;
+		}
+		this->palette = palette;
+		this->palette_generation = palette->generation;
+		dirty_all(&this->dirty, this->num_leds);
+	}
+	return 0;
+}
+
+/* LED frame, with its draw accounted when limiting power */
+static inline uint8_t *put(struct sk9822 *this, size_t i, uint8_t *it, int global, int b, int g, int r)
+{
+	if (this->power) {
+		power_account(this->power, i, global * (b + g + r));
+	}
+	*it++ = 0xe0 | global;
+	*it++ = b;
+	*it++ = g;
+	*it++ = r;
+	return it;
+}
+
+/* Intensity goes to the 5-bit global field, the palette supplies the rest */
+static int encode_indexed(struct sk9822 *this)
+{
+	const struct indexed *indexed = this->indexed;
+	if (check_palette(this, indexed->palette) != 0) {
+		return -1;
+	}
+	const uint8_t (*bytes)[3] = this->calibration ? this->calibrated_palette : indexed->palette->bytes;
+	FOREACH_DIRTY_SPAN(&this->dirty, span) {
+		uint8_t *it = this->message + 4 + 4 * span->begin;
+		for (size_t i = span->begin; i < span->end; ++i) {
+			const uint8_t *rgb = bytes[indexed_get(indexed, i)];
+			it = put(this, i, it, indexed->intensity[i] >> 3, rgb[2], rgb[1], rgb[0]);
+		}
+	}
+	return 0;
+}
+
+static void encode(struct sk9822 *this)
+{
+	FOREACH_DIRTY_SPAN(&this->dirty, span) {
+		uint8_t *it = this->message + 4 + 4 * span->begin;
+		for (size_t i = span->begin; i < span->end; ++i) {
+			const struct led *led = this->leds + i;
+			it = put(this, i, it, (clamp(led->brightness) >> 3) & 0x1f,
+					clamp(led->colour.b), clamp(led->colour.g), clamp(led->colour.r));
+		}
+	}
+}
+
+/* Brightness still goes to the global field, calibration to the colour */
+static void encode_calibrated(struct sk9822 *this)
+{
+	uint8_t rgb[3][CALIBRATION_CHUNK];
+	FOREACH_DIRTY_SPAN(&this->dirty, span) {
+		uint8_t *it = this->message + 4 + 4 * span->begin;
+		for (size_t begin = span->begin; begin < span->end; begin += CALIBRATION_CHUNK) {
+			const struct led *leds = this->leds + begin;
+			const size_t count = span->end - begin < CALIBRATION_CHUNK ? span->end - begin : CALIBRATION_CHUNK;
+			calibration_apply(this->calibration, leds, count, false, rgb);
+			for (size_t k = 0; k < count; ++k) {
+				it = put(this, begin + k, it, (clamp(leds[k].brightness) >> 3) & 0x1f, rgb[2][k], rgb[1][k], rgb[0][k]);
+			}
+		}
+	}
+}
+
+/* Over budget: lower each global field first, then the colour by what remains */
+static void limit(struct sk9822 *this, float scale)
+{
+	for (uint8_t *it = this->message + 4, *end = it + 4 * this->num_leds; it != end; it += 4) {
+		const int global = it[0] & 0x1f;
+		if (!global) {
+			continue;
+		}
+		const float target = global * scale;
+		const int lowered = ceilf(target);
+		const uint32_t factor = target / lowered * 65536;
+		it[0] = 0xe0 | lowered;
+		it[1] = it[1] * factor >> 16;
+		it[2] = it[2] * factor >> 16;
+		it[3] = it[3] * factor >> 16;
+	}
 }
 
 int sk9822_update(struct sk9822 *this)
 {
-	int ret = -1;
-	const size_t message_size = sizeof(uint32_t) * (this->num_leds + 2 + this->num_leds / 64);
-	uint8_t * const message = malloc(message_size);
-	if (!message) {
-		perror("malloc");
-		goto fail0;
-	}
-	memset(message, 0, message_size);
-	uint8_t *it = message + 4;
-	for (const struct led *led = this->leds, *end = led + this->num_leds; led != end; ++led) {
-		*it++ = 0xe0 | ((clamp(led->brightness) >> 3) & 0x1f);
-		*it++ = clamp(led->colour.b);
-		*it++ = clamp(led->colour.g);
-		*it++ = clamp(led->colour.r);
-	}
-	if (write(this->fd, message, message_size) != (ssize_t) message_size) {
-		perror("write");
-		goto fail1;
-	}
-	ret = 0;
-fail1:
-	free(message);
-fail0:
-	return ret;
+	/* A limited wire buffer can't be patched, so starts again from the LEDs */
+	if (this->power && this->power->limited) {
+		dirty_all(&this->dirty, this->num_leds);
+	}
+	TRACE1(encode_start, this->dirty.num_spans);
+	if (this->indexed) {
+		if (encode_indexed(this) != 0) {
+			return -1;
+		}
+	} else if (this->calibration) {
+		encode_calibrated(this);
+	} else {
+		encode(this);
+	}
+	if (this->power) {
+		const float scale = power_frame(this->power);
+		if (scale < 1) {
+			limit(this, scale);
+		}
+	}
+	dirty_clear(&this->dirty);
+	TRACE0(encode_end);
+	return spi_write(this->fd, this->message, this->message_size);
 }
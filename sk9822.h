@@ -1,13 +1,35 @@
 #pragma once
 #include <stddef.h>
 
+#include <stdint.h>
+
 #include "led.h"
+#include "dirty.h"
+#include "palette.h"
+#include "calibration.h"
+#include "power.h"
+
+/* Estimated mA per unit of global field times colour byte, 20mA per die at full */
+#define SK9822_POWER_UNIT (20.0 / (31 * 255))
 
 struct sk9822
 {
 	int fd;
 	size_t num_leds;
 	struct led *leds;
+	/* LEDs to re-encode on next update, the rest of the wire buffer is kept */
+	struct dirty dirty;
+	/* Optional, encoded instead of leds through its palette */
+	struct indexed *indexed;
+	const struct palette *palette;
+	unsigned palette_generation;
+	/* Optional colour correction, applied while encoding */
+	const struct calibration *calibration;
+	uint8_t (*calibrated_palette)[3];
+	/* Optional current limiter, fed while encoding */
+	struct power *power;
+	size_t message_size;
+	uint8_t *message;
 };
 
 struct sk9822 *sk9822_init(const char *spidev, int speed, size_t num_leds);
@@ -0,0 +1,96 @@
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <linux/types.h>
+#include <linux/spi/spidev.h>
+
+#include "spi.h"
+#include "trace.h"
+
+static const char *bufsiz_path = "/sys/module/spidev/parameters/bufsiz";
+
+#define spi_config(fd, name, value) (_spi_config(fd, #name, SPI_IOC_RD_##name, SPI_IOC_WR_##name, value))
+
+static int _spi_config(int fd, const char *name, int read_code, int write_code, int value)
+{
+	if (ioctl(fd, write_code, &value) != 0) {
+		perror("ioctl write");
+		return 1;
+	}
+	int verify = 0;
+	if (ioctl(fd, read_code, &verify) != 0) {
+		perror("ioctl read");
+		return 1;
+	}
+	if (value != verify) {
+		fprintf(stderr, "ioctl write successful but value not set exactly for %s: write %d, read %d\n", name, value, verify);
+	}
+	return 0;
+}
+
+/* spidev rejects any single transfer larger than its bufsiz parameter */
+static int check_bufsiz(size_t message_size)
+{
+	FILE *f = fopen(bufsiz_path, "r");
+	if (!f) {
+		return 0;
+	}
+	unsigned long bufsiz = 0;
+	int ok = fscanf(f, "%lu", &bufsiz) == 1;
+	fclose(f);
+	if (ok && message_size > bufsiz) {
+		fprintf(stderr, "Frame of %zu bytes exceeds spidev bufsiz of %lu, "
+				"set spidev.bufsiz=%zu on the kernel command line\n",
+				message_size, bufsiz, message_size);
+		return -1;
+	}
+	return 0;
+}
+
+int spi_open(const char *spidev, int speed, size_t message_size)
+{
+	int fd = open(spidev, O_RDWR);
+	if (fd < 0) {
+		perror("open(spidev)");
+		return -1;
+	}
+	/* Not a SPI device (file, pipe, /dev/null): write raw frames for recording */
+	int mode;
+	if (ioctl(fd, SPI_IOC_RD_MODE, &mode) != 0 && errno == ENOTTY) {
+		fprintf(stderr, "%s is not a SPI device, writing raw frames\n", spidev);
+		return fd;
+	}
+	if (spi_config(fd, MODE, SPI_NO_CS) != 0) {
+		perror("MODE");
+		goto fail;
+	}
+	if (spi_config(fd, BITS_PER_WORD, 8) != 0) {
+		perror("BITS_PER_WORD");
+		goto fail;
+	}
+	if (spi_config(fd, MAX_SPEED_HZ, speed) != 0) {
+		perror("MAX_SPEED_HZ");
+		goto fail;
+	}
+	if (check_bufsiz(message_size) != 0) {
+		goto fail;
+	}
+	return fd;
+fail:
+	close(fd);
+	return -1;
+}
+
+int spi_write(int fd, const uint8_t *message, size_t message_size)
+{
+	TRACE1(spi_write_start, message_size);
+	ssize_t written = write(fd, message, message_size);
+	TRACE2(spi_write_end, message_size, written);
+	if (written != (ssize_t) message_size) {
+		perror("write");
+		return -1;
+	}
+	return 0;
+}
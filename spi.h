@@ -0,0 +1,6 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+int spi_open(const char *spidev, int speed, size_t message_size);
+int spi_write(int fd, const uint8_t *message, size_t message_size);
@@ -4,39 +4,70 @@
 
 #include "timing.h"
 
-int timing_init(struct timing *this)
+/*
+ * Shared frame clock: sampled once per frame by timing_tick(), all
+ * animations then derive their time-steps from the cached value.
+ */
+static struct
+{
+	enum timing_source source;
+	double virtual_dt;
+	struct timespec epoch;
+	double now;
+} frame_clock;
+
+static double timespec_sub(const struct timespec *a, const struct timespec *b)
+{
+	return (a->tv_sec - b->tv_sec) +
+		((int32_t) a->tv_nsec - (int32_t) b->tv_nsec) * 1e-9;
+}
+
+int timing_clock_init(enum timing_source source, double virtual_dt)
 {
-	if (clock_gettime(CLOCK_MONOTONIC, &this->prev) != 0) {
+	frame_clock.source = source;
+	frame_clock.virtual_dt = virtual_dt;
+	frame_clock.now = 0;
+	if (clock_gettime(CLOCK_MONOTONIC, &frame_clock.epoch) != 0) {
 		perror("failed to get time");
 		return -1;
 	}
 	return 0;
 }
 
-static float timespec_sub(const struct timespec *a, const struct timespec *b)
-{
-	return (a->tv_sec - b->tv_sec) + 
-		((int32_t) a->tv_nsec - (int32_t) b->tv_nsec) * 1e-9f;
-}
-
-double timing_get(const struct timing *this)
+int timing_tick(void)
 {
+	if (frame_clock.source == TIMING_VIRTUAL) {
+		frame_clock.now += frame_clock.virtual_dt;
+		return 0;
+	}
 	struct timespec now;
 	if (clock_gettime(CLOCK_MONOTONIC, &now) != 0) {
 		perror("failed to get time");
-		return NAN;
+		return -1;
 	}
-	return timespec_sub(&now, &this->prev);
+	frame_clock.now = timespec_sub(&now, &frame_clock.epoch);
+	return 0;
+}
+
+double timing_now(void)
+{
+	return frame_clock.now;
+}
+
+int timing_init(struct timing *this)
+{
+	this->prev = frame_clock.now;
+	return 0;
+}
+
+double timing_get(const struct timing *this)
+{
+	return frame_clock.now - this->prev;
 }
 
 float timing_step(struct timing *this)
 {
-	struct timespec now;
-	if (clock_gettime(CLOCK_MONOTONIC, &now) != 0) {
-		perror("failed to get time");
-		return NAN;
-	}
-	float dt = timespec_sub(&now, &this->prev);
-	this->prev = now;
+	float dt = frame_clock.now - this->prev;
+	this->prev = frame_clock.now;
 	return dt;
 }
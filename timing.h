@@ -1,11 +1,23 @@
 #pragma once
 #include <time.h>
 
+enum timing_source
+{
+	/* CLOCK_MONOTONIC, read once per frame */
+	TIMING_REALTIME = 0,
+	/* Fixed time-step per frame, independent of wall-clock */
+	TIMING_VIRTUAL = 1,
+};
+
 struct timing
 {
-	struct timespec prev;
+	double prev;
 };
 
+int timing_clock_init(enum timing_source source, double virtual_dt);
+int timing_tick(void);
+double timing_now(void);
+
 int timing_init(struct timing *this);
 double timing_get(const struct timing *this);
 float timing_step(struct timing *this);
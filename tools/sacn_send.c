@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "colour.h"
+#include "sacn.h"
+
+/* Sends a scrolling rainbow as E1.31 or Art-Net, for testing the sacn source */
+int main(int argc, char *argv[])
+{
+	const char *host = "127.0.0.1";
+	int port = 0;
+	bool artnet = false;
+	int first_universe = 1;
+	int num_leds = 288;
+	int time_step_us = 10000;
+	long num_frames = -1;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "hAH:P:u:l:t:n:")) != -1) {
+		switch (opt) {
+		case 'A':
+			artnet = true;
+			break;
+		case 'H':
+			host = optarg;
+			break;
+		case 'P':
+			port = atoi(optarg);
+			break;
+		case 'u':
+			first_universe = atoi(optarg);
+			break;
+		case 'l':
+			num_leds = atoi(optarg);
+			break;
+		case 't':
+			time_step_us = atof(optarg) * 1000;
+			break;
+		case 'n':
+			num_frames = atol(optarg);
+			break;
+		case '?':
+		default:
+			fprintf(stderr, "Invalid argument\n");
+			goto help;
+		case 'h':
+help:
+			fprintf(stderr, "Syntax: %s"
+					"\n\t [ -A ]  <--Art-Net instead of E1.31"
+					"\n\t [ -H host ]"
+					"\n\t [ -P port ]"
+					"\n\t [ -u first_universe ]"
+					"\n\t [ -l num_leds ]"
+					"\n\t [ -t time_step_ms ]"
+					"\n\t [ -n num_frames ]"
+					"\n", argv[0]);
+			return 1;
+		}
+	}
+	if (!port) {
+		port = artnet ? ARTNET_PORT : SACN_PORT;
+	}
+
+	int fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0) {
+		perror("socket");
+		return 1;
+	}
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_port = htons(port)
+	};
+	if (inet_pton(AF_INET, host, &addr.sin_addr) != 1) {
+		fprintf(stderr, "Invalid host: %s\n", host);
+		close(fd);
+		return 1;
+	}
+
+	const int num_universes = (num_leds + SACN_LEDS_PER_UNIVERSE - 1) / SACN_LEDS_PER_UNIVERSE;
+	uint8_t *data = malloc(num_universes * SACN_LEDS_PER_UNIVERSE * 3);
+	uint8_t packet[SACN_MAX_PACKET];
+	if (!data) {
+		perror("malloc");
+		close(fd);
+		return 1;
+	}
+	memset(data, 0, num_universes * SACN_LEDS_PER_UNIVERSE * 3);
+	for (long frame = 0; frame != num_frames; ++frame) {
+		for (int i = 0; i < num_leds; ++i) {
+			struct hsv hsv = { .h = fmodf((float) i / num_leds + frame * 0.005f, 1), .s = 1, .v = 1 };
+			struct rgb rgb;
+			hsv2rgb(&hsv, &rgb);
+			data[i * 3 + 0] = rgb.r * 255;
+			data[i * 3 + 1] = rgb.g * 255;
+			data[i * 3 + 2] = rgb.b * 255;
+		}
+		for (int u = 0; u < num_universes; ++u) {
+			const int leds = u == num_universes - 1 ? num_leds - u * SACN_LEDS_PER_UNIVERSE : SACN_LEDS_PER_UNIVERSE;
+			const uint8_t *slots = data + u * SACN_LEDS_PER_UNIVERSE * 3;
+			size_t len = artnet ?
+				sacn_build_artnet(packet, first_universe + u, frame % 255 + 1, slots, leds * 3) :
+				sacn_build_e131(packet, first_universe + u, frame, slots, leds * 3);
+			if (sendto(fd, packet, len, 0, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+				perror("sendto");
+			}
+		}
+		usleep(time_step_us);
+	}
+	free(data);
+	close(fd);
+	return 0;
+}
@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <getopt.h>
+
+#include "spidev_shim.h"
+
+enum protocol
+{
+	APA102 = 0,
+	WS2812 = 1,
+	SK6812 = 2
+};
+
+/* Colour with the 5-bit global brightness applied, as rrggbb */
+static size_t decode_apa102(const uint8_t *data, size_t length, bool quiet)
+{
+	size_t leds = 0;
+	/* Start frame, then LED frames which all begin with 111 */
+	for (size_t i = 4; i + 4 <= length && (data[i] & 0xe0) == 0xe0; i += 4, ++leds) {
+		const int global = data[i] & 0x1f;
+		if (!quiet) {
+			printf("%s%02x%02x%02x", leds ? " " : "",
+					(data[i + 3] * global + 15) / 31,
+					(data[i + 2] * global + 15) / 31,
+					(data[i + 1] * global + 15) / 31);
+		}
+	}
+	return leds;
+}
+
+/* One data bit per nibble: 1000 is 0 and 1110 is 1, zeros are the reset */
+static int decode_ws2812_byte(const uint8_t *spi, long *errors)
+{
+	int value = 0;
+	for (int nibble = 0; nibble < 8; ++nibble) {
+		const int bits = (spi[nibble / 2] >> (nibble % 2 ? 0 : 4)) & 0xf;
+		if (bits != 0x8 && bits != 0xe) {
+			++*errors;
+		}
+		value = (value << 1) | (bits == 0xe);
+	}
+	return value;
+}
+
+static size_t decode_ws2812(const uint8_t *data, size_t length, int channels, long *errors, bool quiet)
+{
+	size_t leds = 0;
+	const size_t stride = channels * 4;
+	for (size_t i = 0; i + stride <= length && data[i]; i += stride, ++leds) {
+		int value[4];
+		for (int c = 0; c < channels; ++c) {
+			value[c] = decode_ws2812_byte(data + i + c * 4, errors);
+		}
+		if (quiet) {
+			continue;
+		}
+		/* Wire order is GRB(W) */
+		printf("%s%02x%02x%02x", leds ? " " : "", value[1], value[0], value[2]);
+		if (channels == 4) {
+			printf("%02x", value[3]);
+		}
+	}
+	return leds;
+}
+
+int main(int argc, char *argv[])
+{
+	enum protocol protocol = APA102;
+	bool summary = false;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "hp:s")) != -1) {
+		switch (opt) {
+		case 'p':
+			if (strcasecmp(optarg, "apa102") == 0 || strcasecmp(optarg, "sk9822") == 0) {
+				protocol = APA102;
+			} else if (strcasecmp(optarg, "ws2812") == 0) {
+				protocol = WS2812;
+			} else if (strcasecmp(optarg, "sk6812") == 0) {
+				protocol = SK6812;
+			} else {
+				goto invalid_arg;
+			}
+			break;
+		case 's':
+			summary = true;
+			break;
+		case '?':
+		default:
+invalid_arg:
+			fprintf(stderr, "Invalid argument\n");
+			goto help;
+		case 'h':
+help:
+			fprintf(stderr, "Syntax: %s"
+					"\n\t [ -p { apa102 | sk9822 | ws2812 | sk6812 } ]"
+					"\n\t [ -s ]  <--summary only, no per-frame output"
+					"\n\t capture"
+					"\n", argv[0]);
+			return 1;
+		}
+	}
+	if (optind != argc - 1) {
+		goto help;
+	}
+
+	FILE *f = fopen(argv[optind], "rb");
+	if (!f) {
+		perror("fopen");
+		return 1;
+	}
+	long frames = 0;
+	long errors = 0;
+	uint64_t first_start = 0;
+	uint64_t prev_start = 0;
+	double interval_min = 0;
+	double interval_max = 0;
+	double transfer_sum = 0;
+	struct spidev_shim_record record;
+	uint8_t *data = NULL;
+	while (fread(&record, sizeof(record), 1, f) == 1) {
+		uint8_t *grown = realloc(data, record.length ? record.length : 1);
+		if (!grown) {
+			perror("realloc");
+			break;
+		}
+		data = grown;
+		if (fread(data, 1, record.length, f) != record.length) {
+			fprintf(stderr, "Truncated capture\n");
+			break;
+		}
+		const double interval = frames ? (record.start_ns - prev_start) * 1e-6 : 0;
+		const double transfer = (record.end_ns - record.start_ns) * 1e-6;
+		if (frames == 0) {
+			first_start = record.start_ns;
+		} else if (frames == 1) {
+			interval_min = interval_max = interval;
+		} else {
+			interval_min = interval < interval_min ? interval : interval_min;
+			interval_max = interval > interval_max ? interval : interval_max;
+		}
+		transfer_sum += transfer;
+		if (!summary) {
+			printf("frame %ld start %.6f interval %.3f ms transfer %.3f ms %u bytes %u Hz\n",
+					frames, (record.start_ns - first_start) * 1e-9, interval, transfer,
+					record.length, record.speed_hz);
+		}
+		if (protocol == APA102) {
+			decode_apa102(data, record.length, summary);
+		} else {
+			decode_ws2812(data, record.length, protocol == SK6812 ? 4 : 3, &errors, summary);
+		}
+		if (!summary) {
+			printf("\n");
+		}
+		prev_start = record.start_ns;
+		frames++;
+	}
+	free(data);
+	fclose(f);
+	fprintf(stderr, "%ld frames", frames);
+	if (frames > 1) {
+		fprintf(stderr, ", interval mean %.3f ms min %.3f ms max %.3f ms",
+				(prev_start - first_start) * 1e-6 / (frames - 1), interval_min, interval_max);
+	}
+	if (frames) {
+		fprintf(stderr, ", transfer mean %.3f ms", transfer_sum / frames);
+	}
+	fprintf(stderr, ", %ld bit errors\n", errors);
+	return errors ? 1 : 0;
+}
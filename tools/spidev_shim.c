@@ -0,0 +1,349 @@
+/*
+ * LD_PRELOAD stand-in for /dev/spidev*, for testing without hardware:
+ *
+ *   LD_PRELOAD=./spidev-shim.so SPIDEV_SHIM_CAPTURE=frames.cap ./led-animation
+ *
+ * Accepts spidev's configuration ioctls, enforces its bufsiz limit and
+ * blocks each write() for as long as the transfer would take at the
+ * configured speed.  Transfers can be captured for spidev-decode.
+ *
+ * SPIDEV_SHIM_BUFSIZ   spidev.bufsiz, also served from /sys (default 4096)
+ * SPIDEV_SHIM_CAPTURE  capture file to write
+ */
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/spi/spidev.h>
+
+#include "spidev_shim.h"
+
+#define MAX_DEVICES 8
+
+/* As glibc decides whether open() was passed a mode */
+#define NEEDS_MODE(flags) (((flags) & O_CREAT) || ((flags) & O_TMPFILE) == O_TMPFILE)
+
+static const char *device_prefix = "/dev/spidev";
+static const char *bufsiz_path = "/sys/module/spidev/parameters/bufsiz";
+
+struct device
+{
+	int fd;
+	uint32_t mode;
+	uint8_t bits_per_word;
+	uint8_t lsb_first;
+	uint32_t speed_hz;
+};
+
+static struct device devices[MAX_DEVICES];
+static unsigned long bufsiz = 4096;
+static FILE *capture;
+
+static int (*real_open)(const char *, int, ...);
+static int (*real_open64)(const char *, int, ...);
+static int (*real_openat)(int, const char *, int, ...);
+static int (*real_close)(int);
+static ssize_t (*real_write)(int, const void *, size_t);
+static int (*real_ioctl)(int, unsigned long, ...);
+static FILE *(*real_fopen)(const char *, const char *);
+static FILE *(*real_fopen64)(const char *, const char *);
+
+/* Wrappers can be called before our constructor, by other constructors */
+static void resolve(void)
+{
+	if (real_open) {
+		return;
+	}
+	real_open = dlsym(RTLD_NEXT, "open");
+	real_open64 = dlsym(RTLD_NEXT, "open64");
+	real_openat = dlsym(RTLD_NEXT, "openat");
+	real_close = dlsym(RTLD_NEXT, "close");
+	real_write = dlsym(RTLD_NEXT, "write");
+	real_ioctl = dlsym(RTLD_NEXT, "ioctl");
+	real_fopen = dlsym(RTLD_NEXT, "fopen");
+	real_fopen64 = dlsym(RTLD_NEXT, "fopen64");
+}
+
+__attribute__((constructor))
+static void shim_init(void)
+{
+	resolve();
+	for (int i = 0; i < MAX_DEVICES; ++i) {
+		devices[i].fd = -1;
+	}
+	const char *value = getenv("SPIDEV_SHIM_BUFSIZ");
+	if (value) {
+		bufsiz = strtoul(value, NULL, 0);
+	}
+	const char *path = getenv("SPIDEV_SHIM_CAPTURE");
+	if (path) {
+		capture = real_fopen(path, "w");
+		if (!capture) {
+			perror("spidev-shim: capture");
+		}
+	}
+}
+
+__attribute__((destructor))
+static void shim_free(void)
+{
+	if (capture) {
+		fclose(capture);
+	}
+}
+
+static struct device *find_device(int fd)
+{
+	for (int i = 0; i < MAX_DEVICES; ++i) {
+		if (fd >= 0 && devices[i].fd == fd) {
+			return &devices[i];
+		}
+	}
+	return NULL;
+}
+
+static int is_device(const char *path)
+{
+	return strncmp(path, device_prefix, strlen(device_prefix)) == 0;
+}
+
+/* Backed by /dev/null so the descriptor is real, but never written to */
+static int open_device(void)
+{
+	struct device *device = NULL;
+	for (int i = 0; i < MAX_DEVICES && !device; ++i) {
+		if (devices[i].fd < 0) {
+			device = &devices[i];
+		}
+	}
+	if (!device) {
+		errno = EMFILE;
+		return -1;
+	}
+	int fd = real_open("/dev/null", O_RDWR);
+	if (fd < 0) {
+		return -1;
+	}
+	/* Power-on defaults of the spidev driver */
+	*device = (struct device) { .fd = fd, .bits_per_word = 8, .speed_hz = 500000 };
+	return fd;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+/* Blocks for the time on the wire, as spidev's synchronous transfers do */
+static uint64_t transfer(uint64_t start, size_t bytes, uint32_t speed_hz)
+{
+	const uint64_t end = start + bytes * 8 * 1000000000ull / (speed_hz ? speed_hz : 1);
+	struct timespec until = { .tv_sec = end / 1000000000ull, .tv_nsec = end % 1000000000ull };
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) == EINTR) {
+	}
+	return end;
+}
+
+static void record(uint64_t start, uint64_t end, uint32_t speed_hz, const void *data, size_t length)
+{
+	if (!capture) {
+		return;
+	}
+	struct spidev_shim_record header = {
+		.start_ns = start,
+		.end_ns = end,
+		.speed_hz = speed_hz,
+		.length = length
+	};
+	fwrite(&header, sizeof(header), 1, capture);
+	fwrite(data, 1, length, capture);
+	fflush(capture);
+}
+
+static int device_open(const char *path, int flags, mode_t mode, int (*real)(const char *, int, ...))
+{
+	if (is_device(path)) {
+		return open_device();
+	}
+	return real(path, flags, mode);
+}
+
+int open(const char *path, int flags, ...)
+{
+	resolve();
+	va_list args;
+	va_start(args, flags);
+	mode_t mode = NEEDS_MODE(flags) ? va_arg(args, mode_t) : 0;
+	va_end(args);
+	return device_open(path, flags, mode, real_open);
+}
+
+int open64(const char *path, int flags, ...)
+{
+	resolve();
+	va_list args;
+	va_start(args, flags);
+	mode_t mode = NEEDS_MODE(flags) ? va_arg(args, mode_t) : 0;
+	va_end(args);
+	return device_open(path, flags, mode, real_open64);
+}
+
+int openat(int dirfd, const char *path, int flags, ...)
+{
+	resolve();
+	va_list args;
+	va_start(args, flags);
+	mode_t mode = NEEDS_MODE(flags) ? va_arg(args, mode_t) : 0;
+	va_end(args);
+	if (is_device(path)) {
+		return open_device();
+	}
+	return real_openat(dirfd, path, flags, mode);
+}
+
+/* spi_open reads bufsiz from sysfs, serve ours */
+static FILE *device_fopen(const char *path, const char *mode, FILE *(*real)(const char *, const char *))
+{
+	if (strcmp(path, bufsiz_path) == 0) {
+		char *text;
+		if (asprintf(&text, "%lu\n", bufsiz) < 0) {
+			return NULL;
+		}
+		FILE *f = fmemopen(NULL, strlen(text) + 1, "w+");
+		if (f) {
+			fputs(text, f);
+			rewind(f);
+		}
+		free(text);
+		return f;
+	}
+	return real(path, mode);
+}
+
+FILE *fopen(const char *path, const char *mode)
+{
+	resolve();
+	return device_fopen(path, mode, real_fopen);
+}
+
+FILE *fopen64(const char *path, const char *mode)
+{
+	resolve();
+	return device_fopen(path, mode, real_fopen64);
+}
+
+int close(int fd)
+{
+	resolve();
+	struct device *device = find_device(fd);
+	if (device) {
+		device->fd = -1;
+	}
+	return real_close(fd);
+}
+
+ssize_t write(int fd, const void *buf, size_t count)
+{
+	resolve();
+	struct device *device = find_device(fd);
+	if (!device) {
+		return real_write(fd, buf, count);
+	}
+	if (count > bufsiz) {
+		errno = EMSGSIZE;
+		return -1;
+	}
+	const uint64_t start = now_ns();
+	const uint64_t end = transfer(start, count, device->speed_hz);
+	record(start, end, device->speed_hz, buf, count);
+	return count;
+}
+
+static int message(struct device *device, const struct spi_ioc_transfer *xfers, int n)
+{
+	size_t total = 0;
+	for (int i = 0; i < n; ++i) {
+		total += xfers[i].len;
+	}
+	if (total > bufsiz) {
+		errno = EMSGSIZE;
+		return -1;
+	}
+	for (int i = 0; i < n; ++i) {
+		const uint32_t speed_hz = xfers[i].speed_hz ? xfers[i].speed_hz : device->speed_hz;
+		const uint64_t start = now_ns();
+		const uint64_t end = transfer(start, xfers[i].len, speed_hz);
+		if (xfers[i].tx_buf) {
+			record(start, end, speed_hz, (const void *) (uintptr_t) xfers[i].tx_buf, xfers[i].len);
+		}
+		if (xfers[i].rx_buf) {
+			/* Nothing on MISO */
+			memset((void *) (uintptr_t) xfers[i].rx_buf, 0, xfers[i].len);
+		}
+		if (xfers[i].delay_usecs) {
+			usleep(xfers[i].delay_usecs);
+		}
+	}
+	return total;
+}
+
+int ioctl(int fd, unsigned long request, ...)
+{
+	resolve();
+	va_list args;
+	va_start(args, request);
+	void *arg = va_arg(args, void *);
+	va_end(args);
+	struct device *device = find_device(fd);
+	if (!device) {
+		return real_ioctl(fd, request, arg);
+	}
+	/* The kernel only looks at 32 bits, callers may sign-extend an int */
+	const unsigned int cmd = request;
+	switch (cmd) {
+	case SPI_IOC_RD_MODE:
+		*(uint8_t *) arg = device->mode;
+		return 0;
+	case SPI_IOC_WR_MODE:
+		device->mode = (device->mode & ~0xffu) | *(uint8_t *) arg;
+		return 0;
+	case SPI_IOC_RD_MODE32:
+		*(uint32_t *) arg = device->mode;
+		return 0;
+	case SPI_IOC_WR_MODE32:
+		device->mode = *(uint32_t *) arg;
+		return 0;
+	case SPI_IOC_RD_LSB_FIRST:
+		*(uint8_t *) arg = device->lsb_first;
+		return 0;
+	case SPI_IOC_WR_LSB_FIRST:
+		device->lsb_first = *(uint8_t *) arg;
+		return 0;
+	case SPI_IOC_RD_BITS_PER_WORD:
+		*(uint8_t *) arg = device->bits_per_word;
+		return 0;
+	case SPI_IOC_WR_BITS_PER_WORD:
+		device->bits_per_word = *(uint8_t *) arg;
+		return 0;
+	case SPI_IOC_RD_MAX_SPEED_HZ:
+		*(uint32_t *) arg = device->speed_hz;
+		return 0;
+	case SPI_IOC_WR_MAX_SPEED_HZ:
+		device->speed_hz = *(uint32_t *) arg;
+		return 0;
+	}
+	if (_IOC_TYPE(cmd) == SPI_IOC_MAGIC && _IOC_NR(cmd) == 0 && _IOC_DIR(cmd) == _IOC_WRITE) {
+		return message(device, arg, _IOC_SIZE(cmd) / sizeof(struct spi_ioc_transfer));
+	}
+	errno = ENOTTY;
+	return -1;
+}
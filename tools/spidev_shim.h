@@ -0,0 +1,14 @@
+#pragma once
+#include <stdint.h>
+
+/*
+ * Capture file written by spidev-shim.so, one record per transfer:
+ * this header, then length bytes as sent.  Times are CLOCK_MONOTONIC.
+ */
+struct spidev_shim_record
+{
+	uint64_t start_ns;
+	uint64_t end_ns;
+	uint32_t speed_hz;
+	uint32_t length;
+};
@@ -0,0 +1,27 @@
+#pragma once
+
+/*
+ * USDT static probes under the "led" provider, for perf and bpftrace.
+ * Each probe is a single nop plus an ELF note, and arguments are only
+ * read by the tracer when attached.  Without systemtap's <sys/sdt.h>
+ * (systemtap-sdt-dev) they compile to nothing, unless TRACE_REQUIRE_SDT
+ * is defined, as it is for the profile build, which then fails instead.
+ */
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define TRACE_HAVE_SDT
+#endif
+#endif
+
+#ifdef TRACE_HAVE_SDT
+#define TRACE0(name) DTRACE_PROBE(led, name)
+#define TRACE1(name, a) DTRACE_PROBE1(led, name, a)
+#define TRACE2(name, a, b) DTRACE_PROBE2(led, name, a, b)
+#elif defined(TRACE_REQUIRE_SDT)
+#error "USDT probes need <sys/sdt.h>, install systemtap-sdt-dev"
+#else
+#define TRACE0(name) do { } while (0)
+#define TRACE1(name, a) do { (void) (a); } while (0)
+#define TRACE2(name, a, b) do { (void) (a); (void) (b); } while (0)
+#endif
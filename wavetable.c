@@ -0,0 +1,107 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "wavetable.h"
+#include "util.h"
+
+struct wavetable *wavetable_init(size_t num_leds, struct led *leds, int size,
+		void (*shape)(float u, struct led *out),
+		float (*offset)(size_t i, size_t num_leds))
+{
+	struct wavetable *this = malloc(sizeof(*this));
+	if (!this) {
+		perror("malloc");
+		goto fail;
+	}
+	memset(this, 0, sizeof(*this));
+	this->num_leds = num_leds;
+	this->leds = leds;
+	this->size = size;
+	this->table = malloc(sizeof(*this->table) * (size + 1));
+	this->offset = malloc(sizeof(*this->offset) * num_leds);
+	if (!this->table || !this->offset) {
+		perror("malloc");
+		goto fail;
+	}
+	for (int k = 0; k < size; ++k) {
+		shape((float) k / size, &this->table[k]);
+	}
+	this->table[size] = this->table[0];
+	for (size_t i = 0; i < num_leds; ++i) {
+		this->offset[i] = offset(i, num_leds);
+	}
+	return this;
+fail:
+	wavetable_free(this);
+	return NULL;
+}
+
+void wavetable_render(const struct wavetable *this, float phase, size_t begin, size_t end)
+{
+	const float size = this->size;
+	const struct led *table = this->table;
+	const float *offset = this->offset;
+	phase -= floorf(phase);
+	for (size_t i = begin; i < end; ++i) {
+		float u = phase + offset[i];
+		float x = (u - floorf(u)) * size;
+		int k = x;
+		/* Rounding can land exactly on the end of the period */
+		if (k >= this->size) {
+			k = 0;
+			x = 0;
+		}
+		const float f = x - k;
+		const struct led *a = &table[k];
+		const struct led *b = &table[k + 1];
+		struct led *led = &this->leds[i];
+		led->brightness = interpf(a->brightness, b->brightness, f);
+		led->colour.r = interpf(a->colour.r, b->colour.r, f);
+		led->colour.g = interpf(a->colour.g, b->colour.g, f);
+		led->colour.b = interpf(a->colour.b, b->colour.b, f);
+	}
+}
+
+/* The table is the palette, so each LED takes the nearest sample */
+void wavetable_render_indexed(const struct wavetable *this, float phase, size_t begin, size_t end, struct indexed *indexed)
+{
+	const float size = this->size;
+	const float *offset = this->offset;
+	phase -= floorf(phase);
+	for (size_t i = begin; i < end; ++i) {
+		float u = phase + offset[i];
+		int k = (u - floorf(u)) * size + 0.5f;
+		indexed_set(indexed, i, k >= this->size ? 0 : k, 255);
+	}
+}
+
+struct palette *wavetable_palette(const struct wavetable *this)
+{
+	struct palette *palette = palette_init(this->size);
+	if (!palette) {
+		return NULL;
+	}
+	for (int k = 0; k < this->size; ++k) {
+		const struct led *led = &this->table[k];
+		struct rgb colour = {
+			.r = led->colour.r * led->brightness,
+			.g = led->colour.g * led->brightness,
+			.b = led->colour.b * led->brightness
+		};
+		palette_set(palette, k, &colour);
+	}
+	palette_commit(palette);
+	return palette;
+}
+
+void wavetable_free(struct wavetable *this)
+{
+	if (!this) {
+		return;
+	}
+	free(this->table);
+	free(this->offset);
+	free(this);
+}
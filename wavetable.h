@@ -0,0 +1,34 @@
+#pragma once
+#include <stddef.h>
+
+#include "led.h"
+#include "palette.h"
+
+/*
+ * Travelling waves whose frame is one fixed periodic waveform, sampled
+ * at a per-LED phase offset plus a phase that advances with time.  One
+ * period of the waveform, post-processing and colour included, is
+ * rendered into a table at init so each frame is an interpolated gather.
+ */
+struct wavetable
+{
+	size_t num_leds;
+	struct led *leds;
+	/* Samples per period, the table has one more to wrap interpolation */
+	int size;
+	struct led *table;
+	/* Phase of each LED, in periods */
+	float *offset;
+};
+
+/*
+ * shape gives the colour of the waveform at u in [0, 1), and offset the
+ * phase of LED i in periods.
+ */
+struct wavetable *wavetable_init(size_t num_leds, struct led *leds, int size,
+		void (*shape)(float u, struct led *out),
+		float (*offset)(size_t i, size_t num_leds));
+void wavetable_render(const struct wavetable *this, float phase, size_t begin, size_t end);
+void wavetable_render_indexed(const struct wavetable *this, float phase, size_t begin, size_t end, struct indexed *indexed);
+struct palette *wavetable_palette(const struct wavetable *this);
+void wavetable_free(struct wavetable *this);
@@ -0,0 +1,318 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ws2812.h"
+#include "spi.h"
+#include "trace.h"
+
+/* SPI bytes per data byte, each holding two data bits */
+#define SPI_BYTES 4
+
+/*
+ * Each SPI byte is 0x88 with 0x60 added for a high first bit and 0x06 for
+ * a high second bit, which is arithmetic on the data byte and vectorises
+ * where there are vectors.  The Pi Zero's ARMv6 has none, and there one
+ * table load per data byte is cheaper than the arithmetic.
+ */
+#if defined(__SSE2__) || defined(__ARM_NEON)
+static void init_expand(void)
+{
+}
+
+static void expand_span(uint8_t *restrict out, const uint8_t *restrict in, size_t count)
+{
+	for (size_t k = 0; k < count; ++k) {
+		const unsigned value = in[k];
+		out[SPI_BYTES * k + 0] = 0x88 | (value >> 7 & 1) * 0x60 | (value >> 6 & 1) * 0x06;
+		out[SPI_BYTES * k + 1] = 0x88 | (value >> 5 & 1) * 0x60 | (value >> 4 & 1) * 0x06;
+		out[SPI_BYTES * k + 2] = 0x88 | (value >> 3 & 1) * 0x60 | (value >> 2 & 1) * 0x06;
+		out[SPI_BYTES * k + 3] = 0x88 | (value >> 1 & 1) * 0x60 | (value & 1) * 0x06;
+	}
+}
+#else
+static uint8_t expand[256][SPI_BYTES];
+
+static void init_expand(void)
+{
+	for (int value = 0; value < 256; ++value) {
+		uint32_t bits = 0;
+		for (int bit = 7; bit >= 0; --bit) {
+			bits = (bits << 4) | ((value >> bit) & 1 ? 0xe : 0x8);
+		}
+		expand[value][0] = bits >> 24;
+		expand[value][1] = bits >> 16;
+		expand[value][2] = bits >> 8;
+		expand[value][3] = bits;
+	}
+}
+
+static void expand_span(uint8_t *restrict out, const uint8_t *restrict in, size_t count)
+{
+	for (size_t k = 0; k < count; ++k) {
+		memcpy(out + SPI_BYTES * k, expand[in[k]], SPI_BYTES);
+	}
+}
+#endif
+
+struct ws2812 *ws2812_init(const char *spidev, size_t num_leds, int rgbw)
+{
+	struct ws2812 *this = malloc(sizeof(*this));
+	if (!this) {
+		perror("malloc");
+		return NULL;
+	}
+	memset(this, 0, sizeof(*this));
+	this->fd = -1;
+	init_expand();
+	this->num_leds = num_leds;
+	this->channels = rgbw ? 4 : 3;
+	this->leds = malloc(sizeof(*this->leds) * num_leds);
+	this->data = calloc(num_leds * this->channels, 1);
+	if (!this->leds || !this->data) {
+		perror("malloc");
+		goto fail;
+	}
+	/* LED data, then reset (zeros) */
+	const size_t reset_bytes = (size_t) WS2812_SPI_HZ * WS2812_RESET_US / 1000000 / 8;
+	this->message_size = num_leds * this->channels * SPI_BYTES + reset_bytes;
+	this->message = calloc(this->message_size, 1);
+	if (!this->message) {
+		perror("calloc");
+		goto fail;
+	}
+	this->fd = spi_open(spidev, WS2812_SPI_HZ, this->message_size);
+	if (this->fd < 0) {
+		goto fail;
+	}
+	dirty_all(&this->dirty, num_leds);
+	return this;
+fail:
+	ws2812_free(this);
+	return NULL;
+}
+
+void ws2812_free(struct ws2812 *this)
+{
+	if (!this) {
+		return;
+	}
+	if (this->leds) {
+		free(this->leds);
+	}
+	if (this->data) {
+		free(this->data);
+	}
+	if (this->message) {
+		free(this->message);
+	}
+	if (this->calibrated_palette) {
+		free(this->calibrated_palette);
+	}
+	if (this->fd >= 0) {
+		if (close(this->fd) != 0) {
+			perror("close");
+		}
+	}
+	free(this);
+}
+
+static int quantise(float value)
+{
+	return !(value > 0) ? 0 : value > 1 ? 255 : (int) roundf(value * 255);
+}
+
+static inline uint8_t *put(uint8_t *it, int value)
+{
+	*it = value;
+	return it + 1;
+}
+
+/* One LED in wire order (GRB, then W), with its draw accounted when limiting power */
+static inline uint8_t *put_rgb(struct ws2812 *this, size_t i, uint8_t *it, int r, int g, int b)
+{
+	if (this->power) {
+		power_account(this->power, i, r + g + b);
+	}
+	it = put(it, g);
+	it = put(it, r);
+	return put(it, b);
+}
+
+static inline uint8_t *put_rgbw(struct ws2812 *this, size_t i, uint8_t *it, int r, int g, int b, int w)
+{
+	if (this->power) {
+		power_account(this->power, i, r + g + b + w);
+	}
+	it = put(it, g);
+	it = put(it, r);
+	it = put(it, b);
+	return put(it, w);
+}
+
+/* Palette byte at an intensity, both 0..255 */
+static inline int scale(int value, int intensity)
+{
+	return (value * intensity + 127) / 255;
+}
+
+/* Recolouring changes every LED's wire bytes, calibration is per colour */
+static int check_palette(struct ws2812 *this, const struct palette *palette)
+{
+	if (palette != this->palette || palette->generation != this->palette_generation) {
+		if (this->calibration && calibration_palette_linear(this->calibration, palette, &this->calibrated_palette) != 0) {
+			return -1;
+		}
+		this->palette = palette;
+		this->palette_generation = palette->generation;
+		dirty_all(&this->dirty, this->num_leds);
+	}
+	return 0;
+}
+
+static int encode_indexed(struct ws2812 *this)
+{
+	const size_t stride = this->channels;
+	const struct indexed *indexed = this->indexed;
+	if (check_palette(this, indexed->palette) != 0) {
+		return -1;
+	}
+	const uint8_t (*bytes)[3] = indexed->palette->bytes;
+	const uint16_t (*linear)[3] = this->calibrated_palette;
+	FOREACH_DIRTY_SPAN(&this->dirty, span) {
+		uint8_t *it = this->data + stride * span->begin;
+		for (size_t i = span->begin; i < span->end; ++i) {
+			const int k = indexed->intensity[i];
+			if (this->calibration) {
+				/* Intensity is linear light, so it scales before gamma as brightness does */
+				const uint16_t *index = linear[indexed_get(indexed, i)];
+				const uint8_t (*lut)[CALIBRATION_LUT_SIZE] = this->calibration->lut;
+				const int r = lut[0][(index[0] * k + 127) / 255];
+				const int g = lut[1][(index[1] * k + 127) / 255];
+				const int b = lut[2][(index[2] * k + 127) / 255];
+				if (this->channels == 3) {
+					it = put_rgb(this, i, it, r, g, b);
+				} else {
+					int w = r < g ? r : g;
+					w = w < b ? w : b;
+					it = put_rgbw(this, i, it, r - w, g - w, b - w, w);
+				}
+				continue;
+			}
+			const uint8_t *rgb = bytes[indexed_get(indexed, i)];
+			if (this->channels == 3) {
+				it = put_rgb(this, i, it, scale(rgb[0], k), scale(rgb[1], k), scale(rgb[2], k));
+			} else {
+				int w = rgb[0] < rgb[1] ? rgb[0] : rgb[1];
+				w = w < rgb[2] ? w : rgb[2];
+				it = put_rgbw(this, i, it, scale(rgb[0] - w, k), scale(rgb[1] - w, k), scale(rgb[2] - w, k), scale(w, k));
+			}
+		}
+	}
+	return 0;
+}
+
+static void encode(struct ws2812 *this)
+{
+	const size_t stride = this->channels;
+	FOREACH_DIRTY_SPAN(&this->dirty, span) {
+		uint8_t *it = this->data + stride * span->begin;
+		/* No global brightness field, so it scales the colour */
+		if (this->channels == 3) {
+			for (size_t i = span->begin; i < span->end; ++i) {
+				const struct led *led = this->leds + i;
+				it = put_rgb(this, i, it,
+						quantise(led->colour.r * led->brightness),
+						quantise(led->colour.g * led->brightness),
+						quantise(led->colour.b * led->brightness));
+			}
+		} else {
+			for (size_t i = span->begin; i < span->end; ++i) {
+				const struct led *led = this->leds + i;
+				/* Common part of r, g, b goes to the white die */
+				const float w = fminf(led->colour.r, fminf(led->colour.g, led->colour.b));
+				it = put_rgbw(this, i, it,
+						quantise((led->colour.r - w) * led->brightness),
+						quantise((led->colour.g - w) * led->brightness),
+						quantise((led->colour.b - w) * led->brightness),
+						quantise(w * led->brightness));
+			}
+		}
+	}
+}
+
+/* Brightness is folded in before the matrix, white taken from the result */
+static void encode_calibrated(struct ws2812 *this)
+{
+	const size_t stride = this->channels;
+	uint8_t rgb[3][CALIBRATION_CHUNK];
+	FOREACH_DIRTY_SPAN(&this->dirty, span) {
+		uint8_t *it = this->data + stride * span->begin;
+		for (size_t begin = span->begin; begin < span->end; begin += CALIBRATION_CHUNK) {
+			const size_t count = span->end - begin < CALIBRATION_CHUNK ? span->end - begin : CALIBRATION_CHUNK;
+			calibration_apply(this->calibration, this->leds + begin, count, true, rgb);
+			for (size_t k = 0; k < count; ++k) {
+				if (this->channels == 3) {
+					it = put_rgb(this, begin + k, it, rgb[0][k], rgb[1][k], rgb[2][k]);
+				} else {
+					int w = rgb[0][k] < rgb[1][k] ? rgb[0][k] : rgb[1][k];
+					w = w < rgb[2][k] ? w : rgb[2][k];
+					it = put_rgbw(this, begin + k, it, rgb[0][k] - w, rgb[1][k] - w, rgb[2][k] - w, w);
+				}
+			}
+		}
+	}
+}
+
+/* Over budget: no global field, so every channel is scaled and re-expanded */
+static void limit(struct ws2812 *this, float scale)
+{
+	const uint32_t factor = scale * 65536;
+	for (uint8_t *it = this->data, *end = it + this->num_leds * this->channels; it != end; ++it) {
+		*it = *it * factor >> 16;
+	}
+	dirty_all(&this->dirty, this->num_leds);
+}
+
+int ws2812_encode(struct ws2812 *this)
+{
+	/* A limited wire buffer can't be patched, so starts again from the LEDs */
+	if (this->power && this->power->limited) {
+		dirty_all(&this->dirty, this->num_leds);
+	}
+	TRACE1(encode_start, this->dirty.num_spans);
+	if (this->indexed) {
+		if (encode_indexed(this) != 0) {
+			return -1;
+		}
+	} else if (this->calibration) {
+		encode_calibrated(this);
+	} else {
+		encode(this);
+	}
+	if (this->power) {
+		const float scale = power_frame(this->power);
+		if (scale < 1) {
+			limit(this, scale);
+		}
+	}
+	FOREACH_DIRTY_SPAN(&this->dirty, span) {
+		expand_span(this->message + SPI_BYTES * this->channels * span->begin,
+				this->data + this->channels * span->begin,
+				this->channels * (span->end - span->begin));
+	}
+	dirty_clear(&this->dirty);
+	TRACE0(encode_end);
+	return 0;
+}
+
+int ws2812_update(struct ws2812 *this)
+{
+	if (ws2812_encode(this) != 0) {
+		return -1;
+	}
+	return spi_write(this->fd, this->message, this->message_size);
+}
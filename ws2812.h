@@ -0,0 +1,46 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include "led.h"
+#include "dirty.h"
+#include "palette.h"
+#include "calibration.h"
+#include "power.h"
+
+/* Each data bit is sent as 4 SPI bits of 312.5ns: 1000 for 0, 1110 for 1 */
+#define WS2812_SPI_HZ 3200000
+/* Line held low for >280us after the data latches it (newer WS2812B) */
+#define WS2812_RESET_US 300
+/* Estimated mA per unit of colour byte, 20mA per die at full */
+#define WS2812_POWER_UNIT (20.0 / 255)
+
+struct ws2812
+{
+	int fd;
+	size_t num_leds;
+	/* 3 for WS2812 (GRB), 4 for SK6812 RGBW (GRBW) */
+	int channels;
+	struct led *leds;
+	/* LEDs to re-encode on next update, the rest of the wire buffer is kept */
+	struct dirty dirty;
+	/* Optional, encoded instead of leds through its palette */
+	struct indexed *indexed;
+	const struct palette *palette;
+	unsigned palette_generation;
+	/* Optional colour correction, applied while encoding */
+	const struct calibration *calibration;
+	/* Palette as LUT indices, so intensity scales the light before gamma */
+	uint16_t (*calibrated_palette)[3];
+	/* Optional current limiter, fed while encoding */
+	struct power *power;
+	/* Data bytes in wire order, expanded into message for dirty spans */
+	uint8_t *data;
+	size_t message_size;
+	uint8_t *message;
+};
+
+struct ws2812 *ws2812_init(const char *spidev, size_t num_leds, int rgbw);
+int ws2812_encode(struct ws2812 *this);
+int ws2812_update(struct ws2812 *this);
+void ws2812_free(struct ws2812 *this);
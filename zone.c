@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "zone.h"
+
+int zone_parse(struct zone *this, const char *spec)
+{
+	char name[32];
+	long begin;
+	long num_leds;
+	double period_ms;
+	if (sscanf(spec, "%ld:%ld:%31[^:]:%lf", &begin, &num_leds, name, &period_ms) != 4) {
+		return -1;
+	}
+	const int type = animation_parse(name);
+	if (type < 0 || begin < 0 || num_leds <= 0 || period_ms < 0) {
+		return -1;
+	}
+	memset(this, 0, sizeof(*this));
+	this->begin = begin;
+	this->num_leds = num_leds;
+	this->type = type;
+	this->period = period_ms * 1e-3;
+	return 0;
+}
+
+void zones_run(struct zone *zones, int num_zones, double now, const struct frame_origin *clock, struct dirty *dirty, struct frame_origin *origin,
+		void (*rendered)(void *, size_t, size_t), void *context)
+{
+	for (struct zone *zone = zones, *end = zones + num_zones; zone != end; ++zone) {
+		if (now < zone->due) {
+			continue;
+		}
+		struct animation *animation = zone->animation;
+		animation->update(animation->state);
+		zone->renders++;
+		/* Next render on schedule, or a period from now if it fell behind */
+		zone->due += zone->period;
+		if (zone->due <= now) {
+			zone->due = now + zone->period;
+		}
+		if (animation->dirty) {
+			FOREACH_DIRTY_SPAN(animation->dirty, span) {
+				if (rendered) {
+					rendered(context, zone->begin + span->begin, zone->begin + span->end);
+				}
+				dirty_add(dirty, zone->begin + span->begin, zone->begin + span->end);
+			}
+		} else {
+			if (rendered) {
+				rendered(context, zone->begin, zone->begin + zone->num_leds);
+			}
+			dirty_add(dirty, zone->begin, zone->begin + zone->num_leds);
+		}
+		/* A frame from outside takes precedence over the clock's stamp */
+		const struct frame_origin *stamp = animation->origin ? animation->origin : clock;
+		if (stamp->time && (!origin->time || animation->origin)) {
+			*origin = *stamp;
+		}
+	}
+}
+
+void zones_report(const struct zone *zones, int num_zones, long frames)
+{
+	if (!frames) {
+		return;
+	}
+	for (const struct zone *zone = zones, *end = zones + num_zones; zone != end; ++zone) {
+		fprintf(stderr, "Zone %zu-%zu: %llu renders, %.1f%% of frames\n",
+				zone->begin, zone->begin + zone->num_leds - 1,
+				(unsigned long long) zone->renders,
+				zone->renders * 100.0 / frames);
+	}
+}
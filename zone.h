@@ -0,0 +1,37 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include "animation.h"
+#include "dirty.h"
+#include "latency.h"
+
+#define ZONES_MAX 16
+
+/*
+ * A range of the strip with its own animation, rendered only when due.
+ * Between renders its LEDs keep their last frame and stay out of the
+ * dirty set, so the encoder skips them too.
+ */
+struct zone
+{
+	size_t begin;
+	size_t num_leds;
+	enum animation_type type;
+	/* Seconds between renders, 0 to render on every frame */
+	double period;
+	double due;
+	struct animation *animation;
+	uint64_t renders;
+};
+
+/* start:count:animation:period_ms */
+int zone_parse(struct zone *this, const char *spec);
+/*
+ * Renders the zones that are due, adding what they changed to dirty and
+ * stamping origin.  If given, rendered is called with each span a zone
+ * actually redrew, before dirty merges spans across zones.
+ */
+void zones_run(struct zone *zones, int num_zones, double now, const struct frame_origin *clock, struct dirty *dirty, struct frame_origin *origin,
+		void (*rendered)(void *, size_t, size_t), void *context);
+void zones_report(const struct zone *zones, int num_zones, long frames);